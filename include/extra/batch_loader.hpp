@@ -0,0 +1,233 @@
+
+#pragma once
+
+#include <extra/trait.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace extra
+{
+  // The implementor of trait<Tag, Target> supplies a single-key overload
+  //   Value operator()(Target&, Key const&) const
+  // and, optionally, a batch overload answering the keys in order
+  //   std::vector<Value> operator()(Target&, std::span<Key const>) const
+  template <typename Target, typename Tag, typename Key>
+  concept with_batch_trait =
+    with_trait<Target, Tag> and
+    std::invocable<trait<Tag, Target>, Target&, std::span<Key const>> and
+    std::ranges::sized_range<
+      std::invoke_result_t<trait<Tag, Target>, Target&, std::span<Key const>>>;
+
+  template <typename Target, typename Tag, typename Key>
+  concept with_loader_trait =
+    with_batch_trait<Target, Tag, Key> or
+    (with_trait<Target, Tag> and
+     std::invocable<trait<Tag, Target>, Target&, Key const&>);
+
+  namespace batch_loader_internal
+  {
+    template <typename Tag, typename Target, typename Key>
+    struct value_of
+    {
+      using type = std::remove_cvref_t<
+        std::invoke_result_t<trait<Tag, Target>, Target&, Key const&>>;
+    };
+
+    template <typename Tag, typename Target, typename Key>
+      requires with_batch_trait<Target, Tag, Key>
+    struct value_of<Tag, Target, Key>
+    {
+      using type = std::ranges::range_value_t<
+        std::invoke_result_t<trait<Tag, Target>,
+                             Target&,
+                             std::span<Key const>>>;
+    };
+  } // namespace batch_loader_internal
+
+  struct batch_options
+  {
+    std::size_t               max_batch = 64;
+    std::chrono::microseconds tick{ 200 };
+  };
+
+  // Coalesces concurrent single-key loads. The first caller of a batch
+  // becomes its leader: it waits up to one tick (or until the batch is full),
+  // then issues one deduplicated trait call and fans the results back out.
+  template <typename Tag,
+            typename Target,
+            typename Key,
+            typename Hash     = std::hash<Key>,
+            typename KeyEqual = std::equal_to<Key>>
+    requires with_loader_trait<Target, Tag, Key>
+  class batch_loader
+  {
+  public:
+    using key_type   = Key;
+    using value_type = typename batch_loader_internal::value_of<Tag,
+                                                                Target,
+                                                                Key>::type;
+
+    explicit batch_loader(Target& target, batch_options options = {})
+      : target_(target)
+      , options_(options)
+    {
+      if (options_.max_batch == 0)
+      {
+        throw std::invalid_argument("batch_loader: max_batch must be positive");
+      }
+    }
+
+    batch_loader(batch_loader const&)            = delete;
+    batch_loader& operator=(batch_loader const&) = delete;
+
+    value_type load(Key const& key)
+    {
+      std::unique_lock lock{ mutex_ };
+
+      // a new batch is published only once it holds the key, so a throwing
+      // hash or copy never leaves a batch without a leader
+      auto const leader  = not open_;
+      auto       current = leader ? std::make_shared<batch>() : open_;
+      auto const slot    = enlist(*current, key);
+      if (leader)
+      {
+        open_ = current;
+      }
+
+      if (current->keys.size() >= options_.max_batch)
+      {
+        close(current);
+        current->ready.notify_all();
+      }
+
+      if (leader)
+      {
+        current->ready.wait_for(lock,
+                                options_.tick,
+                                [&current] { return current->closed; });
+        close(current);
+
+        lock.unlock();
+        dispatch(*current);
+        lock.lock();
+
+        dispatched_ +=
+          with_batch_trait<Target, Tag, Key> ? 1 : current->keys.size();
+        current->done = true;
+        current->ready.notify_all();
+      }
+      else
+      {
+        current->ready.wait(lock, [&current] { return current->done; });
+      }
+
+      if (current->error)
+      {
+        std::rethrow_exception(current->error);
+      }
+      return current->values[slot];
+    }
+
+    // Number of trait calls issued so far.
+    std::size_t dispatched() const
+    {
+      std::lock_guard lock{ mutex_ };
+      return dispatched_;
+    }
+
+  private:
+    struct batch
+    {
+      std::vector<Key>                                     keys;
+      std::unordered_map<Key, std::size_t, Hash, KeyEqual> index;
+      std::vector<value_type>                              values;
+      std::exception_ptr                                   error;
+      std::condition_variable                              ready;
+      bool                                                 closed = false;
+      bool                                                 done   = false;
+    };
+
+    // Adds the key to the batch unless it is already there, returns its
+    // slot. The batch is unchanged when it throws.
+    static std::size_t enlist(batch& current, Key const& key)
+    {
+      auto [it, inserted] = current.index.try_emplace(key, current.keys.size());
+      if (inserted)
+      {
+        try
+        {
+          current.keys.push_back(key);
+        }
+        catch (...)
+        {
+          current.index.erase(it);
+          throw;
+        }
+      }
+      return it->second;
+    }
+
+    void close(std::shared_ptr<batch> const& current) noexcept
+    {
+      current->closed = true;
+      if (open_ == current)
+      {
+        open_.reset();
+      }
+    }
+
+    // runs unlocked; the batch is closed, so its keys are no longer touched
+    void dispatch(batch& current) noexcept
+    {
+      try
+      {
+        std::span<Key const> const keys{ current.keys };
+        if constexpr (with_batch_trait<Target, Tag, Key>)
+        {
+          auto&& values = trait_v<Tag, Target>(target_, keys);
+          if (std::ranges::size(values) != keys.size())
+          {
+            throw std::length_error(
+              "batch_loader: batch trait returned a wrong number of values");
+          }
+          current.values.reserve(keys.size());
+          for (auto&& value : values)
+          {
+            current.values.push_back(std::forward<decltype(value)>(value));
+          }
+        }
+        else
+        {
+          current.values.reserve(keys.size());
+          for (auto const& key : keys)
+          {
+            current.values.push_back(trait_v<Tag, Target>(target_, key));
+          }
+        }
+      }
+      catch (...)
+      {
+        current.error = std::current_exception();
+      }
+    }
+
+    Target&                target_;
+    batch_options          options_;
+    mutable std::mutex     mutex_;
+    std::shared_ptr<batch> open_;
+    std::size_t            dispatched_ = 0;
+  };
+} // namespace extra
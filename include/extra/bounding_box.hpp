@@ -0,0 +1,133 @@
+
+#pragma once
+
+#include <extra/trait.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace extra
+{
+  template <typename Scalar, std::size_t Dim>
+  struct aabb
+  {
+    using scalar_type = Scalar;
+
+    static constexpr std::size_t dimensions = Dim;
+
+    std::array<Scalar, Dim> min;
+    std::array<Scalar, Dim> max;
+
+    constexpr bool overlaps(aabb const& other) const noexcept
+    {
+      bool result = true;
+      for (std::size_t d = 0; d < Dim; ++d)
+      {
+        result &= (min[d] <= other.max[d]) & (other.min[d] <= max[d]);
+      }
+      return result;
+    }
+
+    constexpr aabb merged(aabb const& other) const noexcept
+    {
+      aabb result{};
+      for (std::size_t d = 0; d < Dim; ++d)
+      {
+        result.min[d] = std::min(min[d], other.min[d]);
+        result.max[d] = std::max(max[d], other.max[d]);
+      }
+      return result;
+    }
+
+    constexpr Scalar center(std::size_t d) const noexcept
+    {
+      return min[d] + (max[d] - min[d]) / Scalar{ 2 };
+    }
+
+    friend constexpr bool operator==(aabb const&, aabb const&) = default;
+  };
+
+  struct bounding_box
+  {
+    // inject name
+    template <typename...>
+    struct trait_for;
+
+    // delegating impl for closed sets of shapes
+    template <with_trait<bounding_box>... Ts>
+    struct trait_for<std::variant<Ts...>>
+    {
+      constexpr auto operator()(std::variant<Ts...> const& shape) const
+      {
+        return std::visit(trait_v<bounding_box>, shape);
+      }
+    };
+  };
+
+  template <typename T>
+  concept bounded = with_trait<T, bounding_box>;
+
+  template <bounded T>
+  using bounding_box_t =
+    std::remove_cvref_t<std::invoke_result_t<trait<bounding_box, T>, T const&>>;
+
+  namespace bounding_box_internal
+  {
+    template <typename T>
+    inline constexpr bool is_variant_v = false;
+
+    template <typename... Ts>
+    inline constexpr bool is_variant_v<std::variant<Ts...>> = true;
+
+    template <typename T>
+    concept variant_like = is_variant_v<std::remove_cvref_t<T>>;
+  } // namespace bounding_box_internal
+
+  // Hands a candidate pair to a narrow-phase handler (typically an
+  // extra::overload) keyed on the concrete shape types of both sides.
+  template <typename Handler, typename T, typename U>
+  constexpr decltype(auto) visit_pair(Handler&& handler, T&& lhs, U&& rhs)
+  {
+    using bounding_box_internal::variant_like;
+
+    if constexpr (variant_like<T> and variant_like<U>)
+    {
+      return std::visit(std::forward<Handler>(handler),
+                        std::forward<T>(lhs),
+                        std::forward<U>(rhs));
+    }
+    else if constexpr (variant_like<T>)
+    {
+      return std::visit(
+        [&handler, &rhs]<typename Arg>(Arg&& arg) -> decltype(auto)
+        {
+          return std::invoke(std::forward<Handler>(handler),
+                             std::forward<Arg>(arg),
+                             std::forward<U>(rhs));
+        },
+        std::forward<T>(lhs));
+    }
+    else if constexpr (variant_like<U>)
+    {
+      return std::visit(
+        [&handler, &lhs]<typename Arg>(Arg&& arg) -> decltype(auto)
+        {
+          return std::invoke(std::forward<Handler>(handler),
+                             std::forward<T>(lhs),
+                             std::forward<Arg>(arg));
+        },
+        std::forward<U>(rhs));
+    }
+    else
+    {
+      return std::invoke(std::forward<Handler>(handler),
+                         std::forward<T>(lhs),
+                         std::forward<U>(rhs));
+    }
+  }
+} // namespace extra
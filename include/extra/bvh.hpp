@@ -0,0 +1,449 @@
+
+#pragma once
+
+#include <extra/bounding_box.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace extra
+{
+  // Flat bounding volume hierarchy. Nodes are laid out in depth-first order
+  // (the left child of node i is i + 1) and all bounds are stored as
+  // structure of arrays, so leaf overlap tests run over contiguous memory.
+  template <bounded T>
+  class bvh
+  {
+  public:
+    using value_type  = T;
+    using box_type    = bounding_box_t<T>;
+    using scalar_type = typename box_type::scalar_type;
+    using size_type   = std::size_t;
+
+    static constexpr std::size_t dimensions = box_type::dimensions;
+
+    bvh() = default;
+
+    explicit bvh(std::vector<T> values, size_type leaf_size = 4)
+      : values_(std::move(values))
+      , leaf_size_(std::max<size_type>(leaf_size, 1))
+    {
+      build();
+    }
+
+    // Full rebuild; the upper levels of the tree are built in parallel.
+    void build()
+    {
+      auto const count = values_.size();
+
+      boxes_.resize(count);
+      for (size_type id = 0; id < count; ++id)
+      {
+        boxes_[id] = trait_v<bounding_box>(std::as_const(values_[id]));
+      }
+
+      order_.resize(count);
+      std::iota(order_.begin(), order_.end(), size_type{});
+      slot_of_.resize(count);
+      leaf_of_.resize(count);
+      resize_bounds(prim_min_, prim_max_, count);
+
+      auto const nodes = count == 0 ? 0 : node_count(count);
+      nodes_.assign(nodes, node{});
+      resize_bounds(node_min_, node_max_, nodes);
+
+      if (count != 0)
+      {
+        auto const threads = std::max(1u, std::thread::hardware_concurrency());
+        build_node(0, 0, count, no_parent, parallel_depth(threads));
+      }
+
+      boxes_.clear();
+      boxes_.shrink_to_fit();
+    }
+
+    // Incremental update: replaces a value and refits its ancestors only.
+    void update(size_type id, T value)
+    {
+      values_.at(id) = std::move(value);
+      refit(id);
+    }
+
+    // Re-reads the bounding box of a single value and refits its ancestors.
+    void refit(size_type id)
+    {
+      auto const box  = trait_v<bounding_box>(std::as_const(values_.at(id)));
+      auto const slot = slot_of_[id];
+      for (std::size_t d = 0; d < dimensions; ++d)
+      {
+        prim_min_[d][slot] = box.min[d];
+        prim_max_[d][slot] = box.max[d];
+      }
+
+      for (auto index = leaf_of_[slot]; index != no_parent;
+           index      = nodes_[index].parent)
+      {
+        refit_node(index);
+      }
+    }
+
+    // Re-reads every bounding box without changing the topology.
+    void refit()
+    {
+      for (size_type slot = 0; slot < order_.size(); ++slot)
+      {
+        auto const box =
+          trait_v<bounding_box>(std::as_const(values_[order_[slot]]));
+        for (std::size_t d = 0; d < dimensions; ++d)
+        {
+          prim_min_[d][slot] = box.min[d];
+          prim_max_[d][slot] = box.max[d];
+        }
+      }
+
+      // children always follow their parent
+      for (auto index = nodes_.size(); index-- > 0;)
+      {
+        refit_node(index);
+      }
+    }
+
+    T const& operator[](size_type id) const
+    {
+      return values_[id];
+    }
+
+    size_type size() const noexcept
+    {
+      return values_.size();
+    }
+
+    bool empty() const noexcept
+    {
+      return values_.empty();
+    }
+
+    box_type bounds() const
+    {
+      if (nodes_.empty())
+      {
+        throw std::out_of_range("bvh: empty tree has no bounds");
+      }
+      return node_box(0);
+    }
+
+    // Invokes callable(id, value) once for every value overlapping the box.
+    template <typename Callable>
+    void query(box_type const& box, Callable&& callable) const
+    {
+      traverse(box,
+               [&](size_type slot)
+               {
+                 auto const id = order_[slot];
+                 std::invoke(callable, id, values_[id]);
+               });
+    }
+
+    // Broad phase: every overlapping pair is handed once to the narrow-phase
+    // handler, dispatched on the concrete shape types (see visit_pair).
+    template <typename Handler>
+    void for_each_pair(Handler&& handler) const
+    {
+      for (size_type slot = 0; slot < order_.size(); ++slot)
+      {
+        auto const& lhs = values_[order_[slot]];
+        traverse(prim_box(slot),
+                 [&](size_type other)
+                 {
+                   if (other > slot)
+                   {
+                     visit_pair(handler, lhs, values_[order_[other]]);
+                   }
+                 });
+      }
+    }
+
+  private:
+    static constexpr size_type no_parent =
+      std::numeric_limits<size_type>::max();
+
+    // parallel subtree builds stop below this many values
+    static constexpr size_type parallel_grain = 4096;
+
+    using bounds_type = std::array<std::vector<scalar_type>, dimensions>;
+
+    struct node
+    {
+      size_type first  = 0; // leaf: first slot
+      size_type count  = 0; // leaf: number of slots, zero for inner nodes
+      size_type right  = 0; // inner: index of the right child
+      size_type parent = no_parent;
+    };
+
+    static void resize_bounds(bounds_type& lo, bounds_type& hi, size_type n)
+    {
+      for (std::size_t d = 0; d < dimensions; ++d)
+      {
+        lo[d].resize(n);
+        hi[d].resize(n);
+      }
+    }
+
+    static unsigned parallel_depth(unsigned threads) noexcept
+    {
+      unsigned depth = 0;
+      while ((1u << depth) < threads)
+      {
+        ++depth;
+      }
+      return depth;
+    }
+
+    // the layout is a pure function of the value count, so disjoint subtrees
+    // can be written concurrently
+    size_type node_count(size_type count) const noexcept
+    {
+      if (count <= leaf_size_)
+      {
+        return 1;
+      }
+      auto const half = count / 2;
+      return 1 + node_count(half) + node_count(count - half);
+    }
+
+    void build_node(size_type index,
+                    size_type first,
+                    size_type count,
+                    size_type parent,
+                    unsigned  depth)
+    {
+      auto& current  = nodes_[index];
+      current.parent = parent;
+
+      if (count <= leaf_size_)
+      {
+        current.first = first;
+        current.count = count;
+        for (auto slot = first; slot < first + count; ++slot)
+        {
+          auto const  id  = order_[slot];
+          auto const& box = boxes_[id];
+          slot_of_[id]    = slot;
+          leaf_of_[slot]  = index;
+          for (std::size_t d = 0; d < dimensions; ++d)
+          {
+            prim_min_[d][slot] = box.min[d];
+            prim_max_[d][slot] = box.max[d];
+          }
+        }
+        refit_node(index);
+        return;
+      }
+
+      // median split along the widest axis of the centroids
+      auto const begin = order_.begin() + static_cast<std::ptrdiff_t>(first);
+      auto const end   = begin + static_cast<std::ptrdiff_t>(count);
+
+      std::size_t axis   = 0;
+      scalar_type widest = std::numeric_limits<scalar_type>::lowest();
+      for (std::size_t d = 0; d < dimensions; ++d)
+      {
+        auto [lo, hi] = std::minmax_element(
+          begin,
+          end,
+          [&](size_type lhs, size_type rhs)
+          {
+            return boxes_[lhs].center(d) < boxes_[rhs].center(d);
+          });
+        auto const extent = boxes_[*hi].center(d) - boxes_[*lo].center(d);
+        if (extent > widest)
+        {
+          widest = extent;
+          axis   = d;
+        }
+      }
+
+      auto const half = count / 2;
+      std::nth_element(begin,
+                       begin + static_cast<std::ptrdiff_t>(half),
+                       end,
+                       [&](size_type lhs, size_type rhs)
+                       {
+                         return boxes_[lhs].center(axis) <
+                                boxes_[rhs].center(axis);
+                       });
+
+      auto const left  = index + 1;
+      auto const right = left + node_count(half);
+      current.right    = right;
+
+      if (depth > 0 and count >= parallel_grain)
+      {
+        auto const build_left = [=, this]
+        {
+          build_node(left, first, half, index, depth - 1);
+        };
+        auto task = std::async(std::launch::async, build_left);
+        build_node(right, first + half, count - half, index, depth - 1);
+        task.get();
+      }
+      else
+      {
+        build_node(left, first, half, index, 0);
+        build_node(right, first + half, count - half, index, 0);
+      }
+
+      refit_node(index);
+    }
+
+    void refit_node(size_type index) noexcept
+    {
+      auto const& current = nodes_[index];
+      if (current.count != 0)
+      {
+        auto const last = current.first + current.count;
+        for (std::size_t d = 0; d < dimensions; ++d)
+        {
+          auto lo = prim_min_[d][current.first];
+          auto hi = prim_max_[d][current.first];
+          for (auto slot = current.first + 1; slot < last; ++slot)
+          {
+            lo = std::min(lo, prim_min_[d][slot]);
+            hi = std::max(hi, prim_max_[d][slot]);
+          }
+          node_min_[d][index] = lo;
+          node_max_[d][index] = hi;
+        }
+      }
+      else
+      {
+        auto const left  = index + 1;
+        auto const right = current.right;
+        for (std::size_t d = 0; d < dimensions; ++d)
+        {
+          node_min_[d][index] =
+            std::min(node_min_[d][left], node_min_[d][right]);
+          node_max_[d][index] =
+            std::max(node_max_[d][left], node_max_[d][right]);
+        }
+      }
+    }
+
+    box_type node_box(size_type index) const noexcept
+    {
+      box_type box{};
+      for (std::size_t d = 0; d < dimensions; ++d)
+      {
+        box.min[d] = node_min_[d][index];
+        box.max[d] = node_max_[d][index];
+      }
+      return box;
+    }
+
+    box_type prim_box(size_type slot) const noexcept
+    {
+      box_type box{};
+      for (std::size_t d = 0; d < dimensions; ++d)
+      {
+        box.min[d] = prim_min_[d][slot];
+        box.max[d] = prim_max_[d][slot];
+      }
+      return box;
+    }
+
+    bool node_overlaps(size_type index, box_type const& box) const noexcept
+    {
+      bool result = true;
+      for (std::size_t d = 0; d < dimensions; ++d)
+      {
+        result &= (node_min_[d][index] <= box.max[d]) &
+                  (box.min[d] <= node_max_[d][index]);
+      }
+      return result;
+    }
+
+    template <typename Callable>
+    void traverse(box_type const& box, Callable&& callable) const
+    {
+      if (nodes_.empty())
+      {
+        return;
+      }
+
+      // median splits keep the depth logarithmic
+      std::array<size_type, std::numeric_limits<size_type>::digits> stack;
+      size_type top = 0;
+      stack[top++]  = 0;
+
+      while (top != 0)
+      {
+        auto const  index   = stack[--top];
+        auto const& current = nodes_[index];
+
+        if (not node_overlaps(index, box))
+        {
+          continue;
+        }
+
+        if (current.count == 0)
+        {
+          stack[top++] = current.right;
+          stack[top++] = index + 1;
+          continue;
+        }
+
+        // branch-free mask over the contiguous leaf slots
+        std::array<bool, 64> hits{};
+        auto const first = current.first;
+        auto const count = std::min<size_type>(current.count, hits.size());
+        for (size_type i = 0; i < count; ++i)
+        {
+          bool hit = true;
+          for (std::size_t d = 0; d < dimensions; ++d)
+          {
+            hit &= (prim_min_[d][first + i] <= box.max[d]) &
+                   (box.min[d] <= prim_max_[d][first + i]);
+          }
+          hits[i] = hit;
+        }
+
+        for (size_type i = 0; i < count; ++i)
+        {
+          if (hits[i])
+          {
+            callable(first + i);
+          }
+        }
+
+        for (auto slot = first + count; slot < first + current.count; ++slot)
+        {
+          if (prim_box(slot).overlaps(box))
+          {
+            callable(slot);
+          }
+        }
+      }
+    }
+
+    std::vector<T>         values_;
+    size_type              leaf_size_ = 4;
+    std::vector<box_type>  boxes_;   // scratch during build
+    std::vector<size_type> order_;   // slot -> id
+    std::vector<size_type> slot_of_; // id -> slot
+    std::vector<size_type> leaf_of_; // slot -> leaf node
+    std::vector<node>      nodes_;
+    bounds_type            prim_min_;
+    bounds_type            prim_max_;
+    bounds_type            node_min_;
+    bounds_type            node_max_;
+  };
+} // namespace extra
@@ -0,0 +1,243 @@
+
+#pragma once
+
+#include <extra/trait.hpp>
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace extra
+{
+  // Table of every value of an enumeration-like type. Implementations
+  // expose it as a static constexpr array named values.
+  struct enum_values
+  {
+    // inject name
+    template <typename...>
+    struct trait_for;
+
+    // default impl
+    template <std::same_as<bool> T>
+    struct trait_for<T>
+    {
+      static constexpr std::array<bool, 2> values{ false, true };
+    };
+  };
+
+  template <typename T>
+  concept enumerable = with_trait<T, enum_values> and requires {
+    {
+      trait<enum_values, T>::values.size()
+    } -> std::convertible_to<std::size_t>;
+  };
+
+  namespace constant_dispatch_internal
+  {
+    template <typename T>
+    struct underlying
+    {
+      using type = T;
+    };
+
+    template <typename T>
+      requires std::is_enum_v<T>
+    struct underlying<T>
+    {
+      using type = std::underlying_type_t<T>;
+    };
+
+    template <typename T>
+    using underlying_t = typename underlying<T>::type;
+  } // namespace constant_dispatch_internal
+
+  template <auto... Values>
+  struct constant_list
+  {
+    static constexpr std::size_t size = sizeof...(Values);
+
+    template <std::size_t Index>
+    using constant =
+      std::integral_constant<
+        std::tuple_element_t<Index, std::tuple<decltype(Values)...>>,
+        std::get<Index>(std::tuple{ Values... })>;
+
+    // position of a runtime value, size when it is not listed
+    template <typename T>
+    static constexpr std::size_t index_of(T const& value) noexcept
+    {
+      if constexpr (dense<T>)
+      {
+        using underlying = constant_dispatch_internal::underlying_t<T>;
+        auto const offset =
+          static_cast<std::size_t>(static_cast<underlying>(value)) -
+          static_cast<std::size_t>(static_cast<underlying>(first<T>));
+        return offset < size ? offset : size;
+      }
+      else
+      {
+        std::size_t index = 0;
+        (void)((value == Values or (++index, false)) or ...);
+        return index;
+      }
+    }
+
+  private:
+    template <typename T>
+    static constexpr T first = std::get<0>(std::tuple{ Values... });
+
+    // ascending runs of integers or enumerators index by subtraction
+    template <typename T>
+    static constexpr bool dense = []
+    {
+      if constexpr (((std::is_same_v<T, decltype(Values)>) and ...) and
+                    (std::is_integral_v<T> or std::is_enum_v<T>) and
+                    not std::is_same_v<T, bool>)
+      {
+        using underlying = constant_dispatch_internal::underlying_t<T>;
+        std::array<underlying, size> values{ static_cast<underlying>(
+          Values)... };
+        for (std::size_t i = 1; i < size; ++i)
+        {
+          if (values[i] != values[i - 1] + 1)
+          {
+            return false;
+          }
+        }
+        return true;
+      }
+      else
+      {
+        return false;
+      }
+    }();
+  };
+
+  namespace constant_dispatch_internal
+  {
+    template <typename T, std::size_t... I>
+    constexpr auto enum_list(std::index_sequence<I...>)
+      -> constant_list<trait<enum_values, T>::values[I]...>;
+
+    template <enumerable T>
+    using enum_list_t = decltype(enum_list<T>(
+      std::make_index_sequence<trait<enum_values, T>::values.size()>{}));
+
+    template <typename... Lists>
+    inline constexpr std::size_t table_size = (Lists::size * ... * 1);
+
+    // per-list indices of a flat (row-major) table index
+    template <std::size_t Flat, typename... Lists>
+    constexpr auto unflatten() noexcept
+    {
+      std::array<std::size_t, sizeof...(Lists)> indices{};
+      std::array<std::size_t, sizeof...(Lists)> sizes{ Lists::size... };
+      auto                                      rest = Flat;
+      for (auto i = sizeof...(Lists); i-- > 0;)
+      {
+        indices[i] = rest % sizes[i];
+        rest /= sizes[i];
+      }
+      return indices;
+    }
+
+    template <typename Callable, typename... Lists>
+    struct table
+    {
+      template <std::size_t Flat, std::size_t... L>
+      static constexpr decltype(auto) invoke(Callable&& callable,
+                                             std::index_sequence<L...>)
+      {
+        constexpr auto indices = unflatten<Flat, Lists...>();
+        return std::invoke(
+          std::forward<Callable>(callable),
+          typename Lists::template constant<indices[L]>{}...);
+      }
+
+      template <std::size_t Flat>
+      using result_at = decltype(invoke<Flat>(
+        std::declval<Callable>(),
+        std::index_sequence_for<Lists...>{}));
+
+      template <std::size_t... Flat>
+      static constexpr auto make(std::index_sequence<Flat...>)
+      {
+        using result = std::common_type_t<result_at<Flat>...>;
+        using entry  = result (*)(Callable&&);
+        return std::array<entry, sizeof...(Flat)>{ +[](Callable&& callable)
+                                                      -> result
+                                                    {
+                                                      return invoke<Flat>(
+                                                        std::forward<Callable>(
+                                                          callable),
+                                                        std::index_sequence_for<
+                                                          Lists...>{});
+                                                    }... };
+      }
+
+      static constexpr auto entries =
+        make(std::make_index_sequence<table_size<Lists...>>{});
+    };
+  } // namespace constant_dispatch_internal
+
+  // Lifts one runtime value per list into std::integral_constant arguments
+  // of the callable, through a single flattened jump table: the callable is
+  // instantiated, and specialized, once per combination of values.
+  template <typename... Lists, typename... T, typename Callable>
+    requires(sizeof...(Lists) == sizeof...(T) and sizeof...(Lists) > 0)
+  constexpr decltype(auto) with_constants(std::tuple<T...> const& values,
+                                          Callable&&              callable)
+  {
+    using table = constant_dispatch_internal::table<Callable, Lists...>;
+
+    std::size_t flat  = 0;
+    bool        valid = true;
+    [&]<std::size_t... I>(std::index_sequence<I...>)
+    {
+      (
+        [&](std::size_t index, std::size_t size)
+        {
+          valid = valid and index < size;
+          flat  = flat * size + index;
+        }(Lists::index_of(std::get<I>(values)), Lists::size),
+        ...);
+    }(std::index_sequence_for<T...>{});
+
+    if (not valid)
+    {
+      throw std::out_of_range("with_constants: value has no table entry");
+    }
+    return table::entries[flat](std::forward<Callable>(callable));
+  }
+
+  template <auto... Values, typename T, typename Callable>
+    requires(sizeof...(Values) > 0)
+  constexpr decltype(auto) with_constant(T const& value, Callable&& callable)
+  {
+    return with_constants<constant_list<Values...>>(
+      std::tuple<T const&>{ value },
+      std::forward<Callable>(callable));
+  }
+
+  template <enumerable T, typename Callable>
+  constexpr decltype(auto) enum_dispatch(T const& value, Callable&& callable)
+  {
+    return with_constants<constant_dispatch_internal::enum_list_t<T>>(
+      std::tuple<T const&>{ value },
+      std::forward<Callable>(callable));
+  }
+
+  template <enumerable... T, typename Callable>
+  constexpr decltype(auto) enum_dispatch(std::tuple<T...> const& values,
+                                         Callable&&              callable)
+  {
+    return with_constants<constant_dispatch_internal::enum_list_t<T>...>(
+      values,
+      std::forward<Callable>(callable));
+  }
+} // namespace extra
@@ -0,0 +1,511 @@
+
+#pragma once
+
+#include <extra/trait.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace extra
+{
+  enum class priority : std::uint8_t
+  {
+    high,
+    normal,
+    low
+  };
+
+  struct task_priority
+  {
+    // inject name
+    template <typename...>
+    struct trait_for;
+
+    // default impl, unless the adl bridge provides one
+    template <typename T>
+      requires(not trait_internal::has_trait_impl_from_adl<T, task_priority>)
+    struct trait_for<T>
+    {
+      constexpr priority operator()(T const&) const noexcept
+      {
+        return priority::normal;
+      }
+    };
+  };
+
+  // Preferred worker of a task (taken modulo the worker count). It is only a
+  // locality hint: idle workers still steal such tasks.
+  struct task_affinity
+  {
+    // inject name
+    template <typename...>
+    struct trait_for;
+
+    // default impl, unless the adl bridge provides one
+    template <typename T>
+      requires(not trait_internal::has_trait_impl_from_adl<T, task_affinity>)
+    struct trait_for<T>
+    {
+      constexpr std::optional<std::size_t> operator()(T const&) const noexcept
+      {
+        return std::nullopt;
+      }
+    };
+  };
+
+  namespace executor_internal
+  {
+    inline constexpr std::size_t priority_count = 3;
+
+    struct task_base
+    {
+      virtual ~task_base() = default;
+      virtual void run()   = 0;
+    };
+
+    template <typename Callable>
+    struct task final : task_base
+    {
+      explicit task(Callable body)
+        : callable(std::move(body))
+      {}
+
+      void run() override
+      {
+        std::invoke(callable);
+      }
+
+      Callable callable;
+    };
+
+    // Chase-Lev deque: the owner pushes and pops at the bottom, thieves
+    // steal from the top.
+    class work_stealing_deque
+    {
+    public:
+      work_stealing_deque()
+        : ring_(new ring(64))
+      {
+        rings_.emplace_back(ring_.load(std::memory_order_relaxed));
+      }
+
+      work_stealing_deque(work_stealing_deque const&)            = delete;
+      work_stealing_deque& operator=(work_stealing_deque const&) = delete;
+
+      void push(task_base* item)
+      {
+        auto const b = bottom_.load(std::memory_order_relaxed);
+        auto const t = top_.load(std::memory_order_acquire);
+        auto*      a = ring_.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1)
+        {
+          a = grow(a, b, t);
+        }
+        a->put(b, item);
+        bottom_.store(b + 1, std::memory_order_release);
+      }
+
+      task_base* pop()
+      {
+        auto const b = bottom_.load(std::memory_order_relaxed) - 1;
+        auto*      a = ring_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = top_.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+          bottom_.store(b + 1, std::memory_order_relaxed);
+          return nullptr;
+        }
+
+        auto* item = a->get(b);
+        if (t == b)
+        {
+          // last item: race against thieves
+          if (not top_.compare_exchange_strong(t,
+                                               t + 1,
+                                               std::memory_order_seq_cst,
+                                               std::memory_order_relaxed))
+          {
+            item = nullptr;
+          }
+          bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+      }
+
+      task_base* steal()
+      {
+        auto t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto const b = bottom_.load(std::memory_order_acquire);
+
+        if (t >= b)
+        {
+          return nullptr;
+        }
+
+        auto* item = ring_.load(std::memory_order_acquire)->get(t);
+        if (not top_.compare_exchange_strong(t,
+                                             t + 1,
+                                             std::memory_order_seq_cst,
+                                             std::memory_order_relaxed))
+        {
+          return nullptr;
+        }
+        return item;
+      }
+
+    private:
+      struct ring
+      {
+        explicit ring(std::int64_t size)
+          : capacity(size)
+          , slots(new std::atomic<task_base*>[static_cast<std::size_t>(size)])
+        {}
+
+        void put(std::int64_t index, task_base* item) noexcept
+        {
+          slots[static_cast<std::size_t>(index & (capacity - 1))].store(
+            item, std::memory_order_relaxed);
+        }
+
+        task_base* get(std::int64_t index) const noexcept
+        {
+          return slots[static_cast<std::size_t>(index & (capacity - 1))].load(
+            std::memory_order_relaxed);
+        }
+
+        std::int64_t                               capacity;
+        std::unique_ptr<std::atomic<task_base*>[]> slots;
+      };
+
+      ring* grow(ring* old, std::int64_t b, std::int64_t t)
+      {
+        auto* fresh = new ring(old->capacity * 2);
+        rings_.emplace_back(fresh);
+        for (auto i = t; i < b; ++i)
+        {
+          fresh->put(i, old->get(i));
+        }
+        // thieves may still read the old ring, it is retired with the deque
+        ring_.store(fresh, std::memory_order_release);
+        return fresh;
+      }
+
+      alignas(64) std::atomic<std::int64_t> top_{ 0 };
+      alignas(64) std::atomic<std::int64_t> bottom_{ 0 };
+      std::atomic<ring*>                    ring_;
+      std::vector<std::unique_ptr<ring>>    rings_;
+    };
+
+    class locked_queue
+    {
+    public:
+      void push(task_base* item)
+      {
+        std::lock_guard lock{ mutex_ };
+        items_.push_back(item);
+        size_.fetch_add(1, std::memory_order_release);
+      }
+
+      task_base* pop()
+      {
+        if (size_.load(std::memory_order_acquire) == 0)
+        {
+          return nullptr;
+        }
+
+        std::lock_guard lock{ mutex_ };
+        if (items_.empty())
+        {
+          return nullptr;
+        }
+        auto* item = items_.front();
+        items_.pop_front();
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        return item;
+      }
+
+    private:
+      std::mutex               mutex_;
+      std::deque<task_base*>   items_;
+      std::atomic<std::size_t> size_{ 0 };
+    };
+
+    template <typename T>
+    using lanes = std::array<T, priority_count>;
+
+    struct worker
+    {
+      lanes<work_stealing_deque> deques;
+      lanes<locked_queue>        inbox; // tasks with affinity to this worker
+      std::thread                thread;
+    };
+
+    struct context
+    {
+      void const* owner = nullptr;
+      std::size_t index = 0;
+    };
+
+    inline thread_local context current{};
+  } // namespace executor_internal
+
+  // Work-stealing executor: one Chase-Lev deque per worker and priority
+  // lane, idle workers park on an atomic wait. Priority and affinity of a
+  // task come from the task_priority and task_affinity traits of its type.
+  // An exception escaping a submitted task is passed to the error handler on
+  // the worker that ran it; without a handler it calls std::terminate, as an
+  // exception escaping a std::thread would.
+  class executor
+  {
+  public:
+    using error_handler = std::function<void(std::exception_ptr)>;
+
+    explicit executor(
+      std::size_t   concurrency =
+        std::max(1u, std::thread::hardware_concurrency()),
+      error_handler on_error    = {})
+      : workers_(std::max<std::size_t>(concurrency, 1))
+      , on_error_(std::move(on_error))
+    {
+      for (std::size_t index = 0; index < workers_.size(); ++index)
+      {
+        workers_[index].thread = std::thread([this, index] { work(index); });
+      }
+    }
+
+    executor(executor const&)            = delete;
+    executor& operator=(executor const&) = delete;
+
+    // Runs every task already submitted before joining the workers.
+    ~executor()
+    {
+      stop_.store(true, std::memory_order_seq_cst);
+      epoch_.fetch_add(1, std::memory_order_seq_cst);
+      epoch_.notify_all();
+      for (auto& w : workers_)
+      {
+        w.thread.join();
+      }
+    }
+
+    template <typename Callable>
+      requires std::invocable<std::decay_t<Callable>&>
+    void submit(Callable&& callable)
+    {
+      using task_type = std::decay_t<Callable>;
+      auto const p = trait_v<task_priority, task_type>(std::as_const(callable));
+      auto const a = trait_v<task_affinity, task_type>(std::as_const(callable));
+      submit(std::forward<Callable>(callable), p, a);
+    }
+
+    template <typename Callable>
+      requires std::invocable<std::decay_t<Callable>&>
+    void submit(Callable&&                 callable,
+                priority                   p,
+                std::optional<std::size_t> affinity = std::nullopt)
+    {
+      using task_type = executor_internal::task<std::decay_t<Callable>>;
+      enqueue(new task_type(std::forward<Callable>(callable)), p, affinity);
+    }
+
+    // Exceptions are delivered through the future, never to the handler.
+    template <typename Callable>
+      requires std::invocable<std::decay_t<Callable>&>
+    auto async(Callable&& callable)
+    {
+      using task_type = std::decay_t<Callable>;
+      auto const p = trait_v<task_priority, task_type>(std::as_const(callable));
+      auto const a = trait_v<task_affinity, task_type>(std::as_const(callable));
+      return async(std::forward<Callable>(callable), p, a);
+    }
+
+    template <typename Callable,
+              typename Result = std::invoke_result_t<std::decay_t<Callable>&>>
+    std::future<Result> async(
+      Callable&&                 callable,
+      priority                   p,
+      std::optional<std::size_t> affinity = std::nullopt)
+    {
+      auto packaged = std::make_shared<std::packaged_task<Result()>>(
+        std::forward<Callable>(callable));
+      auto future = packaged->get_future();
+      submit([packaged] { (*packaged)(); }, p, affinity);
+      return future;
+    }
+
+    std::size_t concurrency() const noexcept
+    {
+      return workers_.size();
+    }
+
+    // Index of the calling worker, if it belongs to this executor.
+    std::optional<std::size_t> current_worker() const noexcept
+    {
+      auto const& current = executor_internal::current;
+      if (current.owner != this)
+      {
+        return std::nullopt;
+      }
+      return current.index;
+    }
+
+  private:
+    using task_base = executor_internal::task_base;
+
+    static constexpr int spin_rounds = 64;
+
+    void enqueue(task_base*                 item,
+                 priority                   p,
+                 std::optional<std::size_t> affinity)
+    {
+      auto const lane = static_cast<std::size_t>(p);
+      auto const self = current_worker();
+
+      if (affinity and (not self or *affinity % workers_.size() != *self))
+      {
+        workers_[*affinity % workers_.size()].inbox[lane].push(item);
+      }
+      else if (self)
+      {
+        workers_[*self].deques[lane].push(item);
+      }
+      else
+      {
+        injected_[lane].push(item);
+      }
+
+      // pairs with the sleeper registration in work(): either the parking
+      // worker sees the task on its last look, or we see the sleeper
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (sleepers_.load(std::memory_order_seq_cst) != 0)
+      {
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+        epoch_.notify_one();
+      }
+    }
+
+    task_base* find(std::size_t self)
+    {
+      auto& own = workers_[self];
+      for (std::size_t lane = 0; lane < executor_internal::priority_count;
+           ++lane)
+      {
+        if (auto* item = own.inbox[lane].pop())
+        {
+          return item;
+        }
+
+        if (auto* item = own.deques[lane].pop())
+        {
+          return item;
+        }
+
+        if (auto* item = injected_[lane].pop())
+        {
+          return item;
+        }
+
+        for (std::size_t offset = 1; offset < workers_.size(); ++offset)
+        {
+          auto& victim = workers_[(self + offset) % workers_.size()];
+          if (auto* item = victim.deques[lane].steal())
+          {
+            return item;
+          }
+          if (auto* item = victim.inbox[lane].pop())
+          {
+            return item;
+          }
+        }
+      }
+      return nullptr;
+    }
+
+    void work(std::size_t self)
+    {
+      executor_internal::current = { this, self };
+
+      while (true)
+      {
+        task_base* item = nullptr;
+        for (int round = 0; round < spin_rounds and not item; ++round)
+        {
+          item = find(self);
+          if (not item)
+          {
+            std::this_thread::yield();
+          }
+        }
+
+        if (not item)
+        {
+          sleepers_.fetch_add(1, std::memory_order_seq_cst);
+          // pairs with the fence in enqueue(): the last look below cannot
+          // be reordered before the registration
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          auto const epoch = epoch_.load(std::memory_order_seq_cst);
+
+          item = find(self);
+          if (not item)
+          {
+            if (stop_.load(std::memory_order_seq_cst))
+            {
+              sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+              break;
+            }
+            epoch_.wait(epoch, std::memory_order_seq_cst);
+          }
+          sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+        }
+
+        if (item)
+        {
+          run(std::unique_ptr<task_base>{ item });
+        }
+      }
+
+      executor_internal::current = {};
+    }
+
+    void run(std::unique_ptr<task_base> item)
+    {
+      try
+      {
+        item->run();
+      }
+      catch (...)
+      {
+        if (not on_error_)
+        {
+          std::terminate();
+        }
+        on_error_(std::current_exception());
+      }
+    }
+
+    std::vector<executor_internal::worker>                  workers_;
+    executor_internal::lanes<executor_internal::locked_queue> injected_;
+    alignas(64) std::atomic<std::uint32_t>                  epoch_{ 0 };
+    alignas(64) std::atomic<std::uint32_t>                  sleepers_{ 0 };
+    std::atomic<bool>                                       stop_{ false };
+    error_handler                                           on_error_;
+  };
+} // namespace extra
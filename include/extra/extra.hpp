@@ -1,6 +1,15 @@
 
 #pragma once
 
+#include <extra/batch_loader.hpp>    
+#include <extra/bounding_box.hpp>    
+#include <extra/bvh.hpp>             
+#include <extra/constant_dispatch.hpp>
+#include <extra/executor.hpp>        
+#include <extra/ordering.hpp>        
 #include <extra/overload.hpp>        
+#include <extra/record_batch.hpp>    
+#include <extra/serialization.hpp>   
+#include <extra/spatial_grid.hpp>    
 #include <extra/trait.hpp>           
 #include <extra/tuple_algorithm.hpp> 
@@ -0,0 +1,1407 @@
+
+#pragma once
+
+#include <extra/executor.hpp>
+#include <extra/ordering.hpp>
+#include <extra/serialization.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cmath>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <ranges>
+#include <shared_mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+  #endif
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace extra
+{
+  struct lsm_options
+  {
+    std::size_t memtable_bytes     = std::size_t{ 4 } << 20;
+    std::size_t compaction_trigger = 4; // sorted runs before a compaction
+    std::size_t bloom_bits_per_key = 10; // canonical keys only, see below
+  };
+
+  namespace lsm_store_internal
+  {
+    using bytes      = std::span<std::byte const>;
+    using byte_array = std::vector<std::byte>;
+
+    inline constexpr std::uint64_t run_magic = 0x316e75722d6d736cull;
+
+    // the trait of T is the library default impl of Tag
+    template <typename T, typename Tag>
+    concept default_trait =
+      requires { sizeof(typename Tag::template trait_for<T>); } and
+      std::is_base_of_v<typename Tag::template trait_for<T>, trait<Tag, T>>;
+
+    // Keys equivalent under their ordering serialize to identical bytes,
+    // which holds for the default ordering and serialization of scalars and
+    // strings.
+    template <typename Key>
+    inline constexpr bool canonical_keys =
+      default_trait<Key, ordering> and default_trait<Key, serialize>;
+
+    // Serialized keys sort like the keys themselves: narrow strings compare
+    // as unsigned char, as memcmp does.
+    template <typename Key>
+    inline constexpr bool byte_ordered =
+      canonical_keys<Key> and (std::same_as<Key, std::string> or
+                               std::same_as<Key, std::string_view>);
+
+    inline bool bytes_less(bytes lhs, bytes rhs) noexcept
+    {
+      auto const common = std::min(lhs.size(), rhs.size());
+      auto const result =
+        common == 0 ? 0 : std::memcmp(lhs.data(), rhs.data(), common);
+      return result != 0 ? result < 0 : lhs.size() < rhs.size();
+    }
+
+    inline bool bytes_equal(bytes lhs, bytes rhs) noexcept
+    {
+      return lhs.size() == rhs.size() and
+             (lhs.empty() or
+              std::memcmp(lhs.data(), rhs.data(), lhs.size()) == 0);
+    }
+    inline constexpr std::uint32_t tombstone = 0xffffffffu;
+
+    template <typename T>
+    T load(std::byte const* source) noexcept
+    {
+      T value;
+      std::memcpy(&value, source, sizeof(T));
+      return value;
+    }
+
+    template <typename T>
+    void store(byte_array& out, T value)
+    {
+      auto const* first = reinterpret_cast<std::byte const*>(&value);
+      out.insert(out.end(), first, first + sizeof(T));
+    }
+
+    inline std::uint64_t hash(bytes data) noexcept
+    {
+      std::uint64_t h = 0xcbf29ce484222325ull;
+      for (auto b : data)
+      {
+        h ^= static_cast<std::uint64_t>(b);
+        h *= 0x100000001b3ull;
+      }
+      return h;
+    }
+
+    // Bloom filter probed in place from the mapped run.
+    struct bloom_view
+    {
+      bytes         bits;
+      std::uint32_t probes = 0;
+
+      bool may_contain(bytes key) const noexcept
+      {
+        if (bits.empty())
+        {
+          return true;
+        }
+
+        auto const count = static_cast<std::uint64_t>(bits.size()) * 8;
+        auto       h     = hash(key);
+        auto const delta = (h >> 33) | 1;
+        for (std::uint32_t i = 0; i < probes; ++i, h += delta)
+        {
+          auto const bit = h % count;
+          if ((std::to_integer<unsigned>(bits[bit / 8]) & (1u << (bit % 8))) ==
+              0)
+          {
+            return false;
+          }
+        }
+        return true;
+      }
+    };
+
+    class mapped_file
+    {
+    public:
+      explicit mapped_file(std::filesystem::path const& path)
+      {
+#if defined(_WIN32)
+        file_ = ::CreateFileW(path.c_str(),
+                              GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_DELETE,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+        if (file_ == INVALID_HANDLE_VALUE)
+        {
+          throw std::system_error(static_cast<int>(::GetLastError()),
+                                  std::system_category(),
+                                  "lsm_store: open " + path.string());
+        }
+
+        LARGE_INTEGER size{};
+        ::GetFileSizeEx(file_, &size);
+        size_    = static_cast<std::size_t>(size.QuadPart);
+        mapping_ = ::CreateFileMappingW(file_,
+                                        nullptr,
+                                        PAGE_READONLY,
+                                        0,
+                                        0,
+                                        nullptr);
+        if (mapping_ == nullptr)
+        {
+          auto const error = ::GetLastError();
+          ::CloseHandle(file_);
+          throw std::system_error(static_cast<int>(error),
+                                  std::system_category(),
+                                  "lsm_store: map " + path.string());
+        }
+        data_ = static_cast<std::byte const*>(
+          ::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (data_ == nullptr)
+        {
+          auto const error = ::GetLastError();
+          ::CloseHandle(mapping_);
+          ::CloseHandle(file_);
+          throw std::system_error(static_cast<int>(error),
+                                  std::system_category(),
+                                  "lsm_store: map " + path.string());
+        }
+#else
+        auto const fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+          throw std::system_error(errno,
+                                  std::generic_category(),
+                                  "lsm_store: open " + path.string());
+        }
+
+        struct stat info{};
+        ::fstat(fd, &info);
+        size_      = static_cast<std::size_t>(info.st_size);
+        auto* data = size_ == 0 ? MAP_FAILED
+                                : ::mmap(nullptr,
+                                         size_,
+                                         PROT_READ,
+                                         MAP_SHARED,
+                                         fd,
+                                         0);
+        auto const error = errno;
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+          throw std::system_error(error,
+                                  std::generic_category(),
+                                  "lsm_store: map " + path.string());
+        }
+        data_ = static_cast<std::byte const*>(data);
+#endif
+      }
+
+      mapped_file(mapped_file const&)            = delete;
+      mapped_file& operator=(mapped_file const&) = delete;
+
+      ~mapped_file()
+      {
+#if defined(_WIN32)
+        ::UnmapViewOfFile(data_);
+        ::CloseHandle(mapping_);
+        ::CloseHandle(file_);
+#else
+        ::munmap(const_cast<std::byte*>(data_), size_);
+#endif
+      }
+
+      bytes data() const noexcept
+      {
+        return { data_, size_ };
+      }
+
+    private:
+#if defined(_WIN32)
+      HANDLE file_    = INVALID_HANDLE_VALUE;
+      HANDLE mapping_ = nullptr;
+#endif
+      std::byte const* data_ = nullptr;
+      std::size_t      size_ = 0;
+    };
+
+    // Writes the contents aside, syncs them and renames the file into
+    // place, then syncs the directory: after a crash the path holds either
+    // nothing (or its previous file) or the complete contents.
+    inline void write_durably(std::filesystem::path const& path,
+                              bytes                        contents)
+    {
+      auto temporary = path;
+      temporary += ".tmp";
+
+#if defined(_WIN32)
+      auto const fail = [&temporary](char const* what)
+      {
+        auto const error = ::GetLastError();
+        std::error_code ignored;
+        std::filesystem::remove(temporary, ignored);
+        throw std::system_error(static_cast<int>(error),
+                                std::system_category(),
+                                std::string{ "lsm_store: " } + what + " " +
+                                  temporary.string());
+      };
+
+      auto const file = ::CreateFileW(temporary.c_str(),
+                                      GENERIC_WRITE,
+                                      0,
+                                      nullptr,
+                                      CREATE_ALWAYS,
+                                      FILE_ATTRIBUTE_NORMAL,
+                                      nullptr);
+      if (file == INVALID_HANDLE_VALUE)
+      {
+        fail("create");
+      }
+
+      bool written = true;
+      while (written and not contents.empty())
+      {
+        auto const chunk = static_cast<DWORD>(
+          std::min<std::size_t>(contents.size(), std::size_t{ 1 } << 30));
+        DWORD done = 0;
+        written    = ::WriteFile(file, contents.data(), chunk, &done, nullptr);
+        contents   = contents.subspan(done);
+      }
+      written = written and ::FlushFileBuffers(file);
+      ::CloseHandle(file);
+      if (not written)
+      {
+        fail("write");
+      }
+
+      // write-through also flushes the directory entry
+      if (not ::MoveFileExW(temporary.c_str(),
+                            path.c_str(),
+                            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+      {
+        fail("rename");
+      }
+#else
+      auto const fail = [&temporary](int error, char const* what)
+      {
+        std::error_code ignored;
+        std::filesystem::remove(temporary, ignored);
+        throw std::system_error(error,
+                                std::generic_category(),
+                                std::string{ "lsm_store: " } + what + " " +
+                                  temporary.string());
+      };
+
+      auto const fd = ::open(temporary.c_str(),
+                             O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                             0644);
+      if (fd < 0)
+      {
+        fail(errno, "create");
+      }
+
+      int error = 0;
+      while (error == 0 and not contents.empty())
+      {
+        auto const done = ::write(fd, contents.data(), contents.size());
+        if (done >= 0)
+        {
+          contents = contents.subspan(static_cast<std::size_t>(done));
+        }
+        else if (errno != EINTR)
+        {
+          error = errno;
+        }
+      }
+      if (error == 0 and ::fsync(fd) != 0)
+      {
+        error = errno;
+      }
+      if (::close(fd) != 0 and error == 0)
+      {
+        error = errno;
+      }
+      if (error != 0)
+      {
+        fail(error, "write");
+      }
+
+      std::filesystem::rename(temporary, path);
+
+      auto const directory = path.has_parent_path()
+                               ? path.parent_path()
+                               : std::filesystem::path{ "." };
+      auto const dir_fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+      if (dir_fd < 0)
+      {
+        throw std::system_error(errno,
+                                std::generic_category(),
+                                "lsm_store: open " + directory.string());
+      }
+      error = ::fsync(dir_fd) != 0 ? errno : 0;
+      ::close(dir_fd);
+      if (error != 0)
+      {
+        throw std::system_error(error,
+                                std::generic_category(),
+                                "lsm_store: sync " + directory.string());
+      }
+#endif
+    }
+
+    struct run_id
+    {
+      std::uint64_t sequence   = 0; // newest flush covered by the run
+      std::uint64_t generation = 0; // number of compactions behind it
+
+      friend constexpr auto operator<=>(run_id const&, run_id const&) = default;
+
+      std::string file_name() const
+      {
+        char name[64];
+        std::snprintf(name,
+                      sizeof(name),
+                      "%020llu-%06llu.run",
+                      static_cast<unsigned long long>(sequence),
+                      static_cast<unsigned long long>(generation));
+        return name;
+      }
+
+      static std::optional<run_id> parse(std::string const& name)
+      {
+        unsigned long long sequence   = 0;
+        unsigned long long generation = 0;
+        char               tail       = 0;
+        if (name.size() != 31 or
+            std::sscanf(name.c_str(),
+                        "%20llu-%6llu.ru%c",
+                        &sequence,
+                        &generation,
+                        &tail) != 3 or
+            tail != 'n')
+        {
+          return std::nullopt;
+        }
+        return run_id{ sequence, generation };
+      }
+    };
+
+    // Immutable sorted run. Layout:
+    //   entries  { u32 key size, u32 value size or tombstone, key, value }...
+    //   offsets  u64 per entry
+    //   bloom    bit array
+    //   footer   u64 magic, count, offsets position, bloom position,
+    //            u32 bloom probes, u32 reserved
+    class run
+    {
+    public:
+      struct entry
+      {
+        bytes key;
+        bytes value;
+        bool  erased = false;
+      };
+
+      run(std::filesystem::path path, run_id id)
+        : path_(std::move(path))
+        , id_(id)
+        , file_(std::in_place, path_)
+      {
+        auto const data = file_->data();
+        if (data.size() < footer_size or
+            load<std::uint64_t>(data.data() + data.size() - footer_size) !=
+              run_magic)
+        {
+          corrupted();
+        }
+
+        auto const* footer = data.data() + data.size() - footer_size + 8;
+        count_             = load<std::uint64_t>(footer);
+        offsets_           = load<std::uint64_t>(footer + 8);
+        auto const bloom   = load<std::uint64_t>(footer + 16);
+        bloom_.probes      = load<std::uint32_t>(footer + 24);
+
+        // offsets, then bloom bits, then the footer, all inside the file
+        auto const body = data.size() - footer_size;
+        if (offsets_ > bloom or bloom > body or
+            (bloom - offsets_) % 8 != 0 or (bloom - offsets_) / 8 != count_ or
+            bloom_.probes > 64)
+        {
+          corrupted();
+        }
+        bloom_.bits = data.subspan(bloom, body - bloom);
+      }
+
+      run(run const&)            = delete;
+      run& operator=(run const&) = delete;
+
+      // Obsolete runs remove their file once the last reader lets go.
+      ~run()
+      {
+        if (obsolete_)
+        {
+          // unmap first, mapped files cannot be removed everywhere
+          file_.reset();
+          std::error_code ignored;
+          std::filesystem::remove(path_, ignored);
+        }
+      }
+
+      void retire() noexcept
+      {
+        obsolete_ = true;
+      }
+
+      run_id id() const noexcept
+      {
+        return id_;
+      }
+
+      std::size_t size() const noexcept
+      {
+        return static_cast<std::size_t>(count_);
+      }
+
+      bool may_contain(bytes key) const noexcept
+      {
+        return bloom_.may_contain(key);
+      }
+
+      // Throws when the entry does not fit in front of the offsets.
+      entry at(std::size_t index) const
+      {
+        auto const* base   = file_->data().data();
+        auto const  offset = load<std::uint64_t>(base + offsets_ + index * 8);
+        if (offset > offsets_ or offsets_ - offset < 8)
+        {
+          corrupted();
+        }
+
+        auto const* head       = base + offset;
+        auto const  key_size   = load<std::uint32_t>(head);
+        auto const  value_size = load<std::uint32_t>(head + 4);
+        auto const  erased     = value_size == tombstone;
+        auto const  stored     = erased ? 0 : value_size;
+        if (offsets_ - offset - 8 < std::uint64_t{ key_size } + stored)
+        {
+          corrupted();
+        }
+
+        entry result{};
+        result.key    = { head + 8, key_size };
+        result.value  = { head + 8 + key_size, stored };
+        result.erased = erased;
+        return result;
+      }
+
+      static void write(std::filesystem::path const& path,
+                        auto&&                       entries,
+                        std::size_t                  count,
+                        std::size_t                  bloom_bits_per_key)
+      {
+        byte_array                 out;
+        std::vector<std::uint64_t> offsets;
+        offsets.reserve(count);
+
+        auto const bit_count =
+          std::max<std::uint64_t>(64, count * bloom_bits_per_key);
+        byte_array bloom((bit_count + 7) / 8);
+        auto const probes = static_cast<std::uint32_t>(std::clamp(
+          std::lround(static_cast<double>(bloom_bits_per_key) * 0.69),
+          1l,
+          30l));
+
+        entries(
+          [&](bytes key, bytes value, bool erased)
+          {
+            offsets.push_back(out.size());
+            store<std::uint32_t>(out, static_cast<std::uint32_t>(key.size()));
+            store<std::uint32_t>(
+              out,
+              erased ? tombstone : static_cast<std::uint32_t>(value.size()));
+            out.insert(out.end(), key.begin(), key.end());
+            out.insert(out.end(), value.begin(), value.end());
+
+            auto       h     = hash(key);
+            auto const delta = (h >> 33) | 1;
+            for (std::uint32_t i = 0; i < probes; ++i, h += delta)
+            {
+              auto const bit = h % (bloom.size() * 8);
+              bloom[bit / 8] |= std::byte{ 1 } << (bit % 8);
+            }
+          });
+
+        auto const offsets_position = out.size();
+        for (auto offset : offsets)
+        {
+          store(out, offset);
+        }
+        auto const bloom_position = out.size();
+        out.insert(out.end(), bloom.begin(), bloom.end());
+
+        store(out, run_magic);
+        store<std::uint64_t>(out, offsets.size());
+        store<std::uint64_t>(out, offsets_position);
+        store<std::uint64_t>(out, bloom_position);
+        store(out, probes);
+        store<std::uint32_t>(out, 0);
+
+        write_durably(path, out);
+      }
+
+    private:
+      static constexpr std::size_t footer_size = 40;
+
+      [[noreturn]] void corrupted() const
+      {
+        throw std::runtime_error("lsm_store: corrupted run " + path_.string());
+      }
+
+      std::filesystem::path path_;
+      run_id                id_;
+      std::optional<mapped_file> file_;
+      std::uint64_t         count_   = 0;
+      std::uint64_t         offsets_ = 0;
+      bloom_view            bloom_;
+      bool                  obsolete_ = false;
+    };
+  } // namespace lsm_store_internal
+
+  // Embedded log-structured key-value store. Writes land in a skiplist
+  // memtable that is flushed into immutable sorted runs; runs are mapped
+  // read-only, carry a Bloom filter and are merged by a full compaction,
+  // in the background when an executor is supplied. Runs are synced to
+  // disk before they replace anything; the memtable is not logged, so
+  // writes not yet flushed are lost on a crash.
+  //
+  // Keys and values are encoded through the serialize/deserialize traits,
+  // keys are ordered through the ordering trait. Point reads probe the Bloom
+  // filter of a run only for canonical keys (default ordering and
+  // serialization): a customised ordering may treat keys with different
+  // encodings as equal, so their runs are always searched.
+  //
+  // Runs are searched on the serialized bytes for std::string keys; other
+  // keys are decoded at every probe of the binary search, so their lookups
+  // are not zero-copy.
+  //
+  // Reads decode values as any deserializable As; view types (e.g.
+  // std::string_view) point straight into the mapped run and stay valid for
+  // the duration of the callback, so only read and scan accept them.
+  template <typename Key, typename Value>
+    requires serializable<Key> and ordered<Key> and
+             with_trait<Value, serialize>
+  class lsm_store
+  {
+    using bytes      = lsm_store_internal::bytes;
+    using byte_array = lsm_store_internal::byte_array;
+    using run        = lsm_store_internal::run;
+    using run_id     = lsm_store_internal::run_id;
+    using run_ptr    = std::shared_ptr<run>;
+
+  public:
+    using key_type   = Key;
+    using value_type = Value;
+
+    // Throws std::runtime_error when a run of the directory is corrupted,
+    // rather than dropping its contents.
+    explicit lsm_store(std::filesystem::path directory,
+                       lsm_options           options = {},
+                       executor*             background = nullptr)
+      : directory_(std::move(directory))
+      , options_(options)
+      , background_(background)
+    {
+      std::filesystem::create_directories(directory_);
+      open_runs();
+    }
+
+    lsm_store(lsm_store const&)            = delete;
+    lsm_store& operator=(lsm_store const&) = delete;
+
+    ~lsm_store()
+    {
+      try
+      {
+        flush();
+      }
+      catch (...)
+      {
+      }
+
+      std::unique_lock lock{ compaction_mutex_ };
+      compaction_done_.wait(lock, [this] { return not compacting_; });
+    }
+
+    void put(Key const& key, Value const& value)
+    {
+      byte_array encoded;
+      trait_v<serialize, Value>(value, encoded);
+      write(key, std::move(encoded), false);
+    }
+
+    void erase(Key const& key)
+    {
+      write(key, {}, true);
+    }
+
+    template <with_trait<deserialize> As = Value>
+      requires(not std::ranges::view<As>)
+    std::optional<As> get(Key const& key) const
+    {
+      std::optional<As> result;
+      read<As>(key, [&result](As value) { result.emplace(std::move(value)); });
+      return result;
+    }
+
+    // Invokes callable(As) when the key is present, returns whether it was.
+    template <with_trait<deserialize> As = Value, typename Callable>
+    bool read(Key const& key, Callable&& callable) const
+    {
+      std::vector<run_ptr> runs;
+      {
+        std::shared_lock lock{ state_mutex_ };
+        if (auto const* found = memtable_.find(key))
+        {
+          if (found->erased)
+          {
+            return false;
+          }
+          auto const copy = found->value;
+          lock.unlock();
+          callable(trait_v<deserialize, As>(bytes{ copy }));
+          return true;
+        }
+        runs = runs_;
+      }
+
+      auto const encoded = to_bytes(key);
+      for (auto it = runs.rbegin(); it != runs.rend(); ++it)
+      {
+        auto const& current = **it;
+        if constexpr (lsm_store_internal::canonical_keys<Key>)
+        {
+          if (not current.may_contain(encoded))
+          {
+            continue;
+          }
+        }
+
+        auto const index = lower_bound(current, key, encoded);
+        if (index == current.size())
+        {
+          continue;
+        }
+
+        auto const found = current.at(index);
+        if constexpr (lsm_store_internal::canonical_keys<Key>)
+        {
+          if (not lsm_store_internal::bytes_equal(found.key, encoded))
+          {
+            continue;
+          }
+        }
+        else if (not equal(decode_key(found.key), key))
+        {
+          continue;
+        }
+
+        if (found.erased)
+        {
+          return false;
+        }
+        callable(trait_v<deserialize, As>(found.value));
+        return true;
+      }
+      return false;
+    }
+
+    // Invokes callable(Key, As) in key order for every key in [first, last).
+    template <with_trait<deserialize> As = Value, typename Callable>
+    void scan(Key const& first, Key const& last, Callable&& callable) const
+    {
+      std::vector<memtable_entry> recent;
+      std::vector<run_ptr>        runs;
+      {
+        std::shared_lock lock{ state_mutex_ };
+        memtable_.collect(first, last, recent);
+        runs = runs_;
+      }
+
+      auto const          from = to_bytes(first);
+      std::vector<cursor> sources;
+      sources.emplace_back(recent);
+      for (auto it = runs.rbegin(); it != runs.rend(); ++it)
+      {
+        sources.emplace_back(**it, lower_bound(**it, first, from));
+      }
+
+      merge(sources,
+            [&](Key const& key, bytes value, bool erased)
+            {
+              if (not less(key, last))
+              {
+                return false;
+              }
+              if (not erased)
+              {
+                callable(key, trait_v<deserialize, As>(value));
+              }
+              return true;
+            });
+    }
+
+    // Moves the memtable into a new sorted run. Rethrows the error of a
+    // failed compaction, inline or the last background one; the new run is
+    // in place either way.
+    void flush()
+    {
+      {
+        std::lock_guard writer{ write_mutex_ };
+        flush_locked();
+      }
+      raise_background_error();
+    }
+
+    // Merges every run synchronously, waiting for a background compaction.
+    // Rethrows the error of the failed background compaction, if any, or of
+    // this one; the inputs stay in place and the next compaction retries.
+    void compact()
+    {
+      {
+        std::unique_lock lock{ compaction_mutex_ };
+        compaction_done_.wait(lock, [this] { return not compacting_; });
+        if (auto error = std::exchange(background_error_, nullptr))
+        {
+          std::rethrow_exception(error);
+        }
+        compacting_ = true;
+      }
+      compact_runs(false);
+    }
+
+    std::size_t run_count() const
+    {
+      std::shared_lock lock{ state_mutex_ };
+      return runs_.size();
+    }
+
+  private:
+    struct memtable_entry
+    {
+      Key        key;
+      byte_array value;
+      bool       erased = false;
+    };
+
+    class memtable
+    {
+    public:
+      memtable() = default;
+
+      memtable(memtable const&)            = delete;
+      memtable& operator=(memtable const&) = delete;
+
+      memtable_entry const* find(Key const& key) const
+      {
+        auto const* found = seek(key, nullptr);
+        if (found and equal(found->entry.key, key))
+        {
+          return &found->entry;
+        }
+        return nullptr;
+      }
+
+      // returns the growth in encoded bytes
+      std::size_t insert(Key const& key, byte_array value, bool erased)
+      {
+        std::array<links*, max_height> update{};
+        auto* found = const_cast<node*>(seek(key, &update));
+        if (found and equal(found->entry.key, key))
+        {
+          auto const growth   = value.size();
+          found->entry.value  = std::move(value);
+          found->entry.erased = erased;
+          return growth;
+        }
+
+        auto const height = random_height();
+        for (auto level = height_; level < height; ++level)
+        {
+          update[level] = &head_;
+        }
+        height_ = std::max(height_, height);
+
+        auto& created = nodes_.emplace_back(
+          node{ memtable_entry{ key, std::move(value), erased }, {} });
+        for (std::size_t level = 0; level < height; ++level)
+        {
+          created.next[level]  = (*update[level])[level];
+          (*update[level])[level] = &created;
+        }
+        ++size_;
+        return created.entry.value.size() + sizeof(node);
+      }
+
+      void collect(Key const&                   first,
+                   Key const&                   last,
+                   std::vector<memtable_entry>& out) const
+      {
+        for (auto const* current = seek(first, nullptr);
+             current and less(current->entry.key, last);
+             current = current->next[0])
+        {
+          out.push_back(current->entry);
+        }
+      }
+
+      template <typename Callable>
+      void for_each(Callable&& callable) const
+      {
+        for (auto const* current = head_[0]; current;
+             current             = current->next[0])
+        {
+          callable(current->entry);
+        }
+      }
+
+      std::size_t size() const noexcept
+      {
+        return size_;
+      }
+
+      void clear()
+      {
+        nodes_.clear();
+        head_   = {};
+        height_ = 1;
+        size_   = 0;
+      }
+
+    private:
+      static constexpr std::size_t max_height = 16;
+
+      struct node;
+      using links = std::array<node*, max_height>;
+
+      struct node
+      {
+        memtable_entry entry;
+        links          next;
+      };
+
+      // first node not less than the key; update receives the predecessor
+      // links on every level
+      node const* seek(Key const&                      key,
+                       std::array<links*, max_height>* update) const
+      {
+        auto* current = const_cast<links*>(&head_);
+        for (auto level = height_; level-- > 0;)
+        {
+          while ((*current)[level] and less((*current)[level]->entry.key, key))
+          {
+            current = &(*current)[level]->next;
+          }
+          if (update)
+          {
+            (*update)[level] = current;
+          }
+        }
+        return (*current)[0];
+      }
+
+      std::size_t random_height()
+      {
+        std::size_t height = 1;
+        while (height < max_height and (random_() & 3) == 0)
+        {
+          ++height;
+        }
+        return height;
+      }
+
+      links            head_{};
+      std::deque<node> nodes_; // stable addresses
+      std::size_t      height_ = 1;
+      std::size_t      size_   = 0;
+      std::minstd_rand random_{ 0x5eed };
+    };
+
+    // A merge source: the memtable snapshot or a run, positioned in order.
+    class cursor
+    {
+    public:
+      explicit cursor(std::vector<memtable_entry> const& entries)
+        : entries_(&entries)
+        , end_(entries.size())
+      {
+        settle();
+      }
+
+      cursor(run const& source, std::size_t index)
+        : run_(&source)
+        , index_(index)
+        , end_(source.size())
+      {
+        settle();
+      }
+
+      bool valid() const noexcept
+      {
+        return index_ < end_;
+      }
+
+      Key const& key() const noexcept
+      {
+        return *key_;
+      }
+
+      bytes value() const noexcept
+      {
+        return value_;
+      }
+
+      bool erased() const noexcept
+      {
+        return erased_;
+      }
+
+      void next()
+      {
+        ++index_;
+        settle();
+      }
+
+    private:
+      void settle()
+      {
+        if (not valid())
+        {
+          return;
+        }
+
+        if (entries_)
+        {
+          auto const& current = (*entries_)[index_];
+          key_.emplace(current.key);
+          value_  = current.value;
+          erased_ = current.erased;
+        }
+        else
+        {
+          auto const current = run_->at(index_);
+          key_.emplace(decode_key(current.key));
+          value_  = current.value;
+          erased_ = current.erased;
+        }
+      }
+
+      std::vector<memtable_entry> const* entries_ = nullptr;
+      run const*                         run_     = nullptr;
+      std::size_t                        index_   = 0;
+      std::size_t                        end_     = 0;
+      std::optional<Key>                 key_;
+      bytes                              value_;
+      bool                               erased_ = false;
+    };
+
+    static bool less(Key const& lhs, Key const& rhs)
+    {
+      return trait_v<ordering, Key>(lhs, rhs) < 0;
+    }
+
+    static bool equal(Key const& lhs, Key const& rhs)
+    {
+      return trait_v<ordering, Key>(lhs, rhs) == 0;
+    }
+
+    static Key decode_key(bytes encoded)
+    {
+      return trait_v<deserialize, Key>(encoded);
+    }
+
+    // Compares serialized bytes for byte ordered keys, otherwise decodes the
+    // key of every probed entry.
+    static std::size_t lower_bound(run const& source,
+                                   Key const& key,
+                                   bytes      encoded)
+    {
+      auto const before = [&](bytes probed)
+      {
+        if constexpr (lsm_store_internal::byte_ordered<Key>)
+        {
+          return lsm_store_internal::bytes_less(probed, encoded);
+        }
+        else
+        {
+          return less(decode_key(probed), key);
+        }
+      };
+
+      std::size_t first = 0;
+      std::size_t count = source.size();
+      while (count > 0)
+      {
+        auto const half = count / 2;
+        if (before(source.at(first + half).key))
+        {
+          first += half + 1;
+          count -= half + 1;
+        }
+        else
+        {
+          count = half;
+        }
+      }
+      return first;
+    }
+
+    // Visits each key once, taking the entry of the newest source (sources
+    // are sorted newest first). Stops when the visitor returns false.
+    template <typename Visitor>
+    static void merge(std::vector<cursor>& sources, Visitor&& visitor)
+    {
+      while (true)
+      {
+        cursor* newest = nullptr;
+        for (auto& source : sources)
+        {
+          if (source.valid() and
+              (not newest or less(source.key(), newest->key())))
+          {
+            newest = &source;
+          }
+        }
+
+        if (not newest)
+        {
+          return;
+        }
+
+        Key const key = newest->key();
+        if (not visitor(key, newest->value(), newest->erased()))
+        {
+          return;
+        }
+
+        for (auto& source : sources)
+        {
+          if (source.valid() and equal(source.key(), key))
+          {
+            source.next();
+          }
+        }
+      }
+    }
+
+    // runs of other keys carry a minimal filter that is never probed
+    std::size_t bloom_bits_per_key() const noexcept
+    {
+      return lsm_store_internal::canonical_keys<Key>
+               ? options_.bloom_bits_per_key
+               : 0;
+    }
+
+    void open_runs()
+    {
+      std::vector<run_id> ids;
+      for (auto const& item : std::filesystem::directory_iterator(directory_))
+      {
+        auto const name = item.path().filename().string();
+        if (auto id = run_id::parse(name))
+        {
+          ids.push_back(*id);
+        }
+        else if (item.path().extension() == ".tmp")
+        {
+          std::filesystem::remove(item.path());
+        }
+      }
+      std::sort(ids.begin(), ids.end());
+
+      // a compacted run supersedes every older run left by an interrupted
+      // compaction
+      auto const compacted = std::find_if(ids.rbegin(),
+                                          ids.rend(),
+                                          [](run_id const& id)
+                                          {
+                                            return id.generation != 0;
+                                          });
+      if (compacted != ids.rend())
+      {
+        auto const keep = std::prev(compacted.base());
+        for (auto it = ids.begin(); it != keep; ++it)
+        {
+          std::filesystem::remove(directory_ / it->file_name());
+        }
+        ids.erase(ids.begin(), keep);
+      }
+
+      for (auto const& id : ids)
+      {
+        runs_.push_back(
+          std::make_shared<run>(directory_ / id.file_name(), id));
+        next_sequence_ = std::max(next_sequence_, id.sequence + 1);
+      }
+    }
+
+    void write(Key const& key, byte_array value, bool erased)
+    {
+      std::lock_guard writer{ write_mutex_ };
+      {
+        std::unique_lock lock{ state_mutex_ };
+        memtable_bytes_ += memtable_.insert(key, std::move(value), erased);
+      }
+
+      if (memtable_bytes_ >= options_.memtable_bytes)
+      {
+        flush_locked();
+      }
+    }
+
+    void flush_locked()
+    {
+      if (memtable_.size() == 0)
+      {
+        return;
+      }
+
+      run_id const id{ next_sequence_++, 0 };
+      auto const   path = directory_ / id.file_name();
+
+      // the memtable only changes under write_mutex_, held here
+      run::write(
+        path,
+        [this](auto&& emit)
+        {
+          byte_array key;
+          memtable_.for_each(
+            [&](memtable_entry const& entry)
+            {
+              key.clear();
+              trait_v<serialize, Key>(entry.key, key);
+              emit(bytes{ key }, bytes{ entry.value }, entry.erased);
+            });
+        },
+        memtable_.size(),
+        bloom_bits_per_key());
+
+      auto created = std::make_shared<run>(path, id);
+      {
+        std::unique_lock lock{ state_mutex_ };
+        runs_.push_back(std::move(created));
+        memtable_.clear();
+        memtable_bytes_ = 0;
+      }
+
+      schedule_compaction();
+    }
+
+    void schedule_compaction()
+    {
+      if (run_count() < std::max<std::size_t>(options_.compaction_trigger, 2))
+      {
+        return;
+      }
+
+      {
+        std::lock_guard lock{ compaction_mutex_ };
+        if (compacting_)
+        {
+          return;
+        }
+        compacting_ = true;
+      }
+
+      if (not background_)
+      {
+        compact_runs(false);
+        return;
+      }
+
+      try
+      {
+        background_->submit([this] { compact_runs(true); }, priority::low);
+      }
+      catch (...)
+      {
+        std::lock_guard lock{ compaction_mutex_ };
+        compacting_ = false;
+        compaction_done_.notify_all();
+        throw;
+      }
+    }
+
+    void raise_background_error()
+    {
+      std::exception_ptr error;
+      {
+        std::lock_guard lock{ compaction_mutex_ };
+        error = std::exchange(background_error_, nullptr);
+      }
+      if (error)
+      {
+        std::rethrow_exception(error);
+      }
+    }
+
+    // Requires compacting_ to be set by the caller. In the background, it
+    // runs again while flushes made during the merge reach the trigger, and
+    // a failure is kept for the next flush or compact; inline, it rethrows.
+    void compact_runs(bool in_background)
+    {
+      std::exception_ptr error;
+      try
+      {
+        std::vector<run_ptr> inputs;
+        {
+          std::shared_lock lock{ state_mutex_ };
+          inputs = runs_;
+        }
+
+        if (inputs.size() > 1)
+        {
+          run_id id{ inputs.back()->id().sequence, 0 };
+          std::size_t count = 0;
+          for (auto const& input : inputs)
+          {
+            id.generation = std::max(id.generation, input->id().generation);
+            count += input->size();
+          }
+          ++id.generation;
+
+          std::vector<cursor> sources;
+          for (auto it = inputs.rbegin(); it != inputs.rend(); ++it)
+          {
+            sources.emplace_back(**it, 0);
+          }
+
+          auto const path = directory_ / id.file_name();
+          run::write(
+            path,
+            [&sources](auto&& emit)
+            {
+              byte_array key;
+              merge(sources,
+                    [&](Key const& current, bytes value, bool erased)
+                    {
+                      // every older run takes part, tombstones can go
+                      if (not erased)
+                      {
+                        key.clear();
+                        trait_v<serialize, Key>(current, key);
+                        emit(bytes{ key }, value, false);
+                      }
+                      return true;
+                    });
+            },
+            count,
+            bloom_bits_per_key());
+
+          auto merged = std::make_shared<run>(path, id);
+          {
+            std::unique_lock lock{ state_mutex_ };
+            // flushes only append, the inputs are still the oldest runs
+            runs_.erase(runs_.begin(),
+                        runs_.begin() +
+                          static_cast<std::ptrdiff_t>(inputs.size()));
+            runs_.insert(runs_.begin(), std::move(merged));
+          }
+
+          for (auto const& input : inputs)
+          {
+            input->retire();
+          }
+        }
+      }
+      catch (...)
+      {
+        // the inputs stay in place, the next compaction retries
+        error = std::current_exception();
+      }
+
+      if (in_background and not error and
+          run_count() >= std::max<std::size_t>(options_.compaction_trigger, 2))
+      {
+        try
+        {
+          // compacting_ stays set, so the destructor keeps waiting
+          background_->submit([this] { compact_runs(true); }, priority::low);
+          return;
+        }
+        catch (...)
+        {
+          error = std::current_exception();
+        }
+      }
+
+      {
+        std::lock_guard lock{ compaction_mutex_ };
+        compacting_ = false;
+        if (in_background and error)
+        {
+          background_error_ = error;
+        }
+        compaction_done_.notify_all();
+      }
+
+      if (not in_background and error)
+      {
+        std::rethrow_exception(error);
+      }
+    }
+
+    std::filesystem::path directory_;
+    lsm_options           options_;
+    executor*             background_ = nullptr;
+
+    mutable std::shared_mutex state_mutex_; // memtable and runs
+    memtable                  memtable_;
+    std::vector<run_ptr>      runs_; // oldest first
+
+    std::mutex    write_mutex_; // serializes writers and flushes
+    std::size_t   memtable_bytes_ = 0;
+    std::uint64_t next_sequence_  = 1;
+
+    std::mutex              compaction_mutex_;
+    std::condition_variable compaction_done_;
+    bool                    compacting_ = false;
+    std::exception_ptr      background_error_; // raised by flush or compact
+  };
+} // namespace extra
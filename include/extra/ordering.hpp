@@ -0,0 +1,33 @@
+
+#pragma once
+
+#include <extra/trait.hpp>
+
+#include <compare>
+
+namespace extra
+{
+  // Strict weak ordering of a type, returned as std::weak_ordering or
+  // stronger.
+  struct ordering
+  {
+    // inject name
+    template <typename...>
+    struct trait_for;
+
+    // default impl, unless the adl bridge provides one
+    template <std::three_way_comparable<std::weak_ordering> T>
+      requires(not trait_internal::has_trait_impl_from_adl<T, ordering>)
+    struct trait_for<T>
+    {
+      constexpr std::weak_ordering operator()(T const& lhs,
+                                              T const& rhs) const
+      {
+        return std::compare_three_way{}(lhs, rhs);
+      }
+    };
+  };
+
+  template <typename T>
+  concept ordered = with_trait<T, ordering>;
+} // namespace extra
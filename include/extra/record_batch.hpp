@@ -0,0 +1,355 @@
+
+#pragma once
+
+#include <extra/tuple_algorithm.hpp>
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace extra
+{
+  namespace record_batch_internal
+  {
+    // rows per tile: one tile of rows stays in L1 while every column of it
+    // is written or read
+    template <typename Row>
+    inline constexpr std::size_t tile_rows =
+      std::max<std::size_t>(16, (std::size_t{ 16 } << 10) / sizeof(Row));
+
+    // Columns the kernel writes into resized storage; the others are copy
+    // constructed in place instead of default constructed and assigned.
+    template <typename T>
+    inline constexpr bool transposable =
+      std::is_trivially_default_constructible_v<T> and
+      std::is_trivially_copy_assignable_v<T>;
+
+    // One field of a tile through a constant stride, without branches. The
+    // gain comes from the tile staying in cache; the strided loads are not
+    // vectorized.
+    template <std::size_t I, typename Row, typename T>
+    void gather(Row const* rows, std::size_t count, T* column)
+    {
+      for (std::size_t r = 0; r < count; ++r)
+      {
+        column[r] = std::get<I>(rows[r]);
+      }
+    }
+
+    template <std::size_t I, typename Row, typename T>
+    void scatter(T const* column, std::size_t count, Row* rows)
+    {
+      for (std::size_t r = 0; r < count; ++r)
+      {
+        std::get<I>(rows[r]) = column[r];
+      }
+    }
+
+    // AoS to SoA, tile by tile and column by column inside a tile. Only
+    // transposable columns are written.
+    template <typename... Ts, std::size_t... I>
+    void transpose(std::tuple<Ts...> const* rows,
+                   std::size_t              count,
+                   std::tuple<Ts*...>       columns,
+                   std::index_sequence<I...>)
+    {
+      constexpr auto tile = tile_rows<std::tuple<Ts...>>;
+      for (std::size_t first = 0; first < count; first += tile)
+      {
+        auto const size = std::min(tile, count - first);
+        (
+          [&]
+          {
+            if constexpr (transposable<Ts>)
+            {
+              gather<I>(rows + first, size, std::get<I>(columns) + first);
+            }
+          }(),
+          ...);
+      }
+    }
+
+    // SoA to AoS, same tiling.
+    template <typename... Ts, std::size_t... I>
+    void transpose(std::tuple<Ts const*...> columns,
+                   std::size_t              count,
+                   std::tuple<Ts...>*       rows,
+                   std::index_sequence<I...>)
+    {
+      constexpr auto tile = tile_rows<std::tuple<Ts...>>;
+      for (std::size_t first = 0; first < count; first += tile)
+      {
+        auto const size = std::min(tile, count - first);
+        (scatter<I>(std::get<I>(columns) + first, size, rows + first), ...);
+      }
+    }
+  } // namespace record_batch_internal
+
+  // Non-owning columnar window over a record_batch; slicing never copies.
+  // Ts may be const qualified for read-only views.
+  template <typename... Ts>
+  class record_batch_view
+  {
+  public:
+    using row_type       = std::tuple<std::remove_const_t<Ts>...>;
+    using reference_type = std::tuple<Ts&...>;
+
+    record_batch_view() = default;
+
+    record_batch_view(std::tuple<std::span<Ts>...> columns, std::size_t size)
+      : columns_(std::move(columns))
+      , size_(size)
+    {}
+
+    std::size_t size() const noexcept
+    {
+      return size_;
+    }
+
+    bool empty() const noexcept
+    {
+      return size_ == 0;
+    }
+
+    template <std::size_t I>
+    auto column() const noexcept
+    {
+      return std::get<I>(columns_);
+    }
+
+    reference_type row(std::size_t index) const noexcept
+    {
+      return std::apply([index](auto const&... columns)
+                        { return reference_type{ columns[index]... }; },
+                        columns_);
+    }
+
+    record_batch_view slice(std::size_t offset, std::size_t count) const
+    {
+      if (offset > size_ or count > size_ - offset)
+      {
+        throw std::out_of_range("record_batch_view: slice out of range");
+      }
+
+      return { std::apply([=](auto const&... columns)
+                          {
+                            return std::tuple{ columns.subspan(offset,
+                                                               count)... };
+                          },
+                          columns_),
+               count };
+    }
+
+    // SoA to AoS into rows.size() == size() rows.
+    void copy_rows(std::span<row_type> rows) const
+    {
+      if (rows.size() != size_)
+      {
+        throw std::length_error("record_batch_view: row count mismatch");
+      }
+
+      record_batch_internal::transpose(
+        std::apply([](auto const&... columns)
+                   {
+                     return std::tuple<std::remove_const_t<Ts> const*...>{
+                       columns.data()...
+                     };
+                   },
+                   columns_),
+        size_,
+        rows.data(),
+        std::index_sequence_for<Ts...>{});
+    }
+
+    std::vector<row_type> to_rows() const
+      requires std::default_initializable<row_type>
+    {
+      std::vector<row_type> rows(size_);
+      copy_rows(rows);
+      return rows;
+    }
+
+  private:
+    std::tuple<std::span<Ts>...> columns_;
+    std::size_t                  size_ = 0;
+  };
+
+  // Columnar batch of records received as std::tuple<Ts...> rows. Columns
+  // are contiguous, so bool (std::vector<bool>) is not a column type.
+  template <typename... Ts>
+    requires(sizeof...(Ts) > 0 and
+             ((std::copy_constructible<Ts> and not std::is_const_v<Ts> and
+               not std::is_same_v<Ts, bool>) and
+              ...))
+  class record_batch
+  {
+  public:
+    using row_type = std::tuple<Ts...>;
+
+    record_batch() = default;
+
+    explicit record_batch(std::span<row_type const> rows)
+    {
+      append(rows);
+    }
+
+    std::size_t size() const noexcept
+    {
+      return std::get<0>(columns_).size();
+    }
+
+    bool empty() const noexcept
+    {
+      return size() == 0;
+    }
+
+    void reserve(std::size_t capacity)
+    {
+      std::apply(
+        [capacity](auto&... columns)
+        {
+          (columns.reserve(capacity), ...);
+        },
+        columns_);
+    }
+
+    void clear() noexcept
+    {
+      std::apply([](auto&... columns) { (columns.clear(), ...); }, columns_);
+    }
+
+    void push_back(row_type const& row)
+    {
+      append(std::span<row_type const>{ &row, 1 });
+    }
+
+    // AoS to SoA through the tiled transpose kernel. Leaves the batch
+    // unchanged when a copy throws.
+    void append(std::span<row_type const> rows)
+    {
+      auto const offset = size();
+      try
+      {
+        [&]<std::size_t... I>(std::index_sequence<I...>)
+        {
+          (grow<I>(rows), ...);
+        }(std::index_sequence_for<Ts...>{});
+      }
+      catch (...)
+      {
+        std::apply(
+          [offset](auto&... columns)
+          { (columns.erase(columns.begin() + offset, columns.end()), ...); },
+          columns_);
+        throw;
+      }
+
+      record_batch_internal::transpose(
+        rows.data(),
+        rows.size(),
+        std::apply([offset](auto&... columns)
+                   { return std::tuple{ (columns.data() + offset)... }; },
+                   columns_),
+        std::index_sequence_for<Ts...>{});
+    }
+
+    template <std::size_t I>
+    auto column() noexcept
+    {
+      return std::span{ std::get<I>(columns_) };
+    }
+
+    template <std::size_t I>
+    auto column() const noexcept
+    {
+      return std::span{ std::get<I>(columns_) };
+    }
+
+    record_batch_view<Ts...> view() noexcept
+    {
+      return { std::apply([](auto&... columns)
+                          { return std::tuple{ std::span<Ts>{ columns }... }; },
+                          columns_),
+               size() };
+    }
+
+    record_batch_view<Ts const...> view() const noexcept
+    {
+      return { std::apply(
+                 [](auto const&... columns)
+                 { return std::tuple{ std::span<Ts const>{ columns }... }; },
+                 columns_),
+               size() };
+    }
+
+    record_batch_view<Ts...> slice(std::size_t offset, std::size_t count)
+    {
+      return view().slice(offset, count);
+    }
+
+    record_batch_view<Ts const...> slice(std::size_t offset,
+                                         std::size_t count) const
+    {
+      return view().slice(offset, count);
+    }
+
+    std::vector<row_type> to_rows() const
+      requires std::default_initializable<row_type>
+    {
+      return view().to_rows();
+    }
+
+  private:
+    // Makes room for the rows in column I: transposable columns are resized
+    // for the kernel, the others receive copies of their fields.
+    template <std::size_t I>
+    void grow(std::span<row_type const> rows)
+    {
+      auto&      column = std::get<I>(columns_);
+      auto const needed = column.size() + rows.size();
+      if constexpr (record_batch_internal::transposable<
+                      std::tuple_element_t<I, row_type>>)
+      {
+        column.resize(needed);
+      }
+      else
+      {
+        if (column.capacity() < needed)
+        {
+          column.reserve(std::max(needed, 2 * column.capacity()));
+        }
+        for (auto const& row : rows)
+        {
+          column.push_back(std::get<I>(row));
+        }
+      }
+    }
+
+    std::tuple<std::vector<Ts>...> columns_;
+  };
+
+  template <typename... Ts>
+  record_batch(std::span<std::tuple<Ts...> const>) -> record_batch<Ts...>;
+
+  // Runs tuple_visit over every row of the view, in order. Returns false as
+  // soon as a predicate visitor stops a row, like tuple_visit itself.
+  template <typename Callable, typename... Ts>
+  constexpr bool tuple_visit_rows(Callable&&                      visitor,
+                                  record_batch_view<Ts...> const& view)
+  {
+    for (std::size_t index = 0; index < view.size(); ++index)
+    {
+      if (not tuple_visit(visitor, view.row(index)))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+} // namespace extra
@@ -0,0 +1,126 @@
+
+#pragma once
+
+#include <extra/trait.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace extra
+{
+  // Appends the encoding of a value to a byte buffer.
+  struct serialize
+  {
+    // inject name
+    template <typename...>
+    struct trait_for;
+
+    // raw copy of scalars, unless the adl bridge provides an impl
+    template <typename T>
+      requires(std::is_arithmetic_v<T> or std::is_enum_v<T>) and
+              (not trait_internal::has_trait_impl_from_adl<T, serialize>)
+    struct trait_for<T>
+    {
+      void operator()(T const& value, std::vector<std::byte>& out) const
+      {
+        auto const* first = reinterpret_cast<std::byte const*>(&value);
+        out.insert(out.end(), first, first + sizeof(T));
+      }
+    };
+
+    template <typename Char, typename Traits>
+    struct trait_for<std::basic_string_view<Char, Traits>>
+    {
+      void operator()(std::basic_string_view<Char, Traits> value,
+                      std::vector<std::byte>&              out) const
+      {
+        auto const* first = reinterpret_cast<std::byte const*>(value.data());
+        out.insert(out.end(), first, first + value.size() * sizeof(Char));
+      }
+    };
+
+    template <typename Char, typename Traits, typename Alloc>
+    struct trait_for<std::basic_string<Char, Traits, Alloc>>
+      : trait_for<std::basic_string_view<Char, Traits>>
+    {};
+  };
+
+  // Decodes a value from exactly the bytes produced by serialize. View types
+  // (string views) point into the source bytes instead of copying them.
+  struct deserialize
+  {
+    // inject name
+    template <typename...>
+    struct trait_for;
+
+    template <typename T>
+      requires(std::is_arithmetic_v<T> or std::is_enum_v<T>) and
+              (not trait_internal::has_trait_impl_from_adl<T, deserialize>)
+    struct trait_for<T>
+    {
+      T operator()(std::span<std::byte const> bytes) const
+      {
+        if (bytes.size() != sizeof(T))
+        {
+          throw std::length_error("deserialize: unexpected scalar size");
+        }
+
+        T value;
+        std::memcpy(&value, bytes.data(), sizeof(T));
+        return value;
+      }
+    };
+
+    template <typename Char, typename Traits>
+    struct trait_for<std::basic_string_view<Char, Traits>>
+    {
+      std::basic_string_view<Char, Traits>
+      operator()(std::span<std::byte const> bytes) const
+      {
+        if (bytes.size() % sizeof(Char) != 0)
+        {
+          throw std::length_error("deserialize: unexpected string size");
+        }
+
+        return { reinterpret_cast<Char const*>(bytes.data()),
+                 bytes.size() / sizeof(Char) };
+      }
+    };
+
+    template <typename Char, typename Traits, typename Alloc>
+    struct trait_for<std::basic_string<Char, Traits, Alloc>>
+    {
+      std::basic_string<Char, Traits, Alloc>
+      operator()(std::span<std::byte const> bytes) const
+      {
+        return std::basic_string<Char, Traits, Alloc>{
+          trait_for<std::basic_string_view<Char, Traits>>{}(bytes)
+        };
+      }
+    };
+  };
+
+  template <typename T>
+  concept serializable = with_trait<T, serialize> and
+                         with_trait<T, deserialize>;
+
+  template <with_trait<serialize> T>
+  std::vector<std::byte> to_bytes(T const& value)
+  {
+    std::vector<std::byte> out;
+    trait_v<serialize, T>(value, out);
+    return out;
+  }
+
+  template <with_trait<deserialize> T>
+  T from_bytes(std::span<std::byte const> bytes)
+  {
+    return trait_v<deserialize, T>(bytes);
+  }
+} // namespace extra
@@ -0,0 +1,527 @@
+
+#pragma once
+
+#include <extra/bounding_box.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace extra
+{
+  namespace spatial_grid_internal
+  {
+    template <std::size_t Dim>
+    using cell_key = std::array<std::int64_t, Dim>;
+
+    template <std::size_t Dim>
+    struct cell_range
+    {
+      cell_key<Dim> lo;
+      cell_key<Dim> hi;
+
+      friend constexpr bool operator==(cell_range const&,
+                                       cell_range const&) = default;
+    };
+
+    // Cell coordinates are clamped to this magnitude, so huge and infinite
+    // boxes still map to a representable range (clamped cells stay shared).
+    inline constexpr double cell_limit = 0x1p40;
+
+    template <std::size_t Dim>
+    constexpr double cell_count(cell_range<Dim> const& range) noexcept
+    {
+      double count = 1;
+      for (std::size_t d = 0; d < Dim; ++d)
+      {
+        count *= static_cast<double>(range.hi[d] - range.lo[d]) + 1;
+      }
+      return count;
+    }
+
+    template <std::size_t Dim>
+    constexpr bool in_range(cell_key<Dim> const&   cell,
+                            cell_range<Dim> const& range) noexcept
+    {
+      bool result = true;
+      for (std::size_t d = 0; d < Dim; ++d)
+      {
+        result &= (range.lo[d] <= cell[d]) & (cell[d] <= range.hi[d]);
+      }
+      return result;
+    }
+
+    template <std::size_t Dim>
+    struct cell_hash
+    {
+      std::size_t operator()(cell_key<Dim> const& key) const noexcept
+      {
+        std::uint64_t h = 0xcbf29ce484222325ull;
+        for (auto coord : key)
+        {
+          h ^= static_cast<std::uint64_t>(coord) + 0x9e3779b97f4a7c15ull +
+               (h << 6) + (h >> 2);
+        }
+        return static_cast<std::size_t>(h);
+      }
+    };
+
+    // odometer over every cell of an inclusive range
+    template <std::size_t Dim, typename Callable>
+    void for_each_cell(cell_range<Dim> const& range, Callable&& callable)
+    {
+      auto cell = range.lo;
+      while (true)
+      {
+        callable(std::as_const(cell));
+
+        std::size_t d = 0;
+        for (; d < Dim; ++d)
+        {
+          if (cell[d] < range.hi[d])
+          {
+            ++cell[d];
+            break;
+          }
+          cell[d] = range.lo[d];
+        }
+
+        if (d == Dim)
+        {
+          return;
+        }
+      }
+    }
+
+    // A pair spanning several shared cells is reported from exactly one of
+    // them: the cell at the lower corner of the intersection of both ranges.
+    template <std::size_t Dim>
+    constexpr bool is_owner_cell(cell_key<Dim> const& cell,
+                                 cell_key<Dim> const& lhs_lo,
+                                 cell_key<Dim> const& rhs_lo) noexcept
+    {
+      bool result = true;
+      for (std::size_t d = 0; d < Dim; ++d)
+      {
+        result &= cell[d] == std::max(lhs_lo[d], rhs_lo[d]);
+      }
+      return result;
+    }
+  } // namespace spatial_grid_internal
+
+  template <bounded T>
+  class spatial_grid
+  {
+  public:
+    using value_type  = T;
+    using box_type    = bounding_box_t<T>;
+    using scalar_type = typename box_type::scalar_type;
+    using size_type   = std::size_t;
+
+    static constexpr std::size_t dimensions = box_type::dimensions;
+
+    // Upper bound on the cells a single value may be linked into.
+    static constexpr std::size_t max_cells_per_value = std::size_t{ 1 } << 20;
+
+    explicit spatial_grid(scalar_type cell_size)
+      : cell_size_(cell_size)
+    {
+      if (not(cell_size > scalar_type{}))
+      {
+        throw std::invalid_argument("spatial_grid: cell size must be positive");
+      }
+    }
+
+    // Throws std::invalid_argument for a non-finite or inverted box and
+    // std::length_error for a box covering more than max_cells_per_value.
+    // The grid is left unchanged when it throws.
+    size_type insert(T value)
+    {
+      auto const box   = trait_v<bounding_box>(std::as_const(value));
+      auto const range = checked_range_of(box);
+
+      size_type id = values_.size();
+      if (free_.empty())
+      {
+        values_.emplace_back(std::move(value));
+        try
+        {
+          ranges_.push_back(range);
+          for (std::size_t d = 0; d < dimensions; ++d)
+          {
+            min_[d].push_back(box.min[d]);
+            max_[d].push_back(box.max[d]);
+          }
+          link(id, range);
+        }
+        catch (...)
+        {
+          truncate(id);
+          throw;
+        }
+      }
+      else
+      {
+        id = free_.back();
+        link(id, range);
+        try
+        {
+          values_[id] = std::move(value);
+        }
+        catch (...)
+        {
+          unlink(id, range);
+          throw;
+        }
+        free_.pop_back();
+        ranges_[id] = range;
+        store_box(id, box);
+      }
+
+      ++size_;
+      return id;
+    }
+
+    // Replaces the value and relinks it only when its cell range changes.
+    // Throws like insert; the links stay unchanged.
+    void update(size_type id, T value)
+    {
+      check(id);
+      auto const box   = trait_v<bounding_box>(std::as_const(value));
+      auto const range = checked_range_of(box);
+      if (range == ranges_[id])
+      {
+        *values_[id] = std::move(value);
+      }
+      else
+      {
+        link(id, range);
+        try
+        {
+          *values_[id] = std::move(value);
+        }
+        catch (...)
+        {
+          unlink(id, range);
+          throw;
+        }
+        unlink(id, ranges_[id]);
+        ranges_[id] = range;
+      }
+      store_box(id, box);
+    }
+
+    // Re-reads the bounding box of a value mutated in place. Throws like
+    // insert, the value then keeps its previous cells.
+    void refresh(size_type id)
+    {
+      check(id);
+      auto const box   = trait_v<bounding_box>(std::as_const(*values_[id]));
+      auto const range = checked_range_of(box);
+      if (range != ranges_[id])
+      {
+        link(id, range);
+        unlink(id, ranges_[id]);
+        ranges_[id] = range;
+      }
+      store_box(id, box);
+    }
+
+    void erase(size_type id)
+    {
+      check(id);
+      unlink(id, ranges_[id]);
+      values_[id].reset();
+      free_.push_back(id);
+      --size_;
+    }
+
+    bool contains(size_type id) const noexcept
+    {
+      return id < values_.size() and values_[id].has_value();
+    }
+
+    T const& operator[](size_type id) const
+    {
+      check(id);
+      return *values_[id];
+    }
+
+    size_type size() const noexcept
+    {
+      return size_;
+    }
+
+    bool empty() const noexcept
+    {
+      return size_ == 0;
+    }
+
+    void clear() noexcept
+    {
+      values_.clear();
+      ranges_.clear();
+      free_.clear();
+      cells_.clear();
+      for (std::size_t d = 0; d < dimensions; ++d)
+      {
+        min_[d].clear();
+        max_[d].clear();
+      }
+      size_ = 0;
+    }
+
+    // Invokes callable(id, value) once for every value overlapping the box.
+    // Boxes covering more cells than are occupied scan the occupied cells
+    // instead, so the cost is bounded by the grid contents either way.
+    template <typename Callable>
+    void query(box_type const& box, Callable&& callable) const
+    {
+      auto const range = range_of(box);
+      if (not range)
+      {
+        return;
+      }
+
+      auto const visit = [&](key_type const& cell, auto const& ids)
+      {
+        for (auto id : ids)
+        {
+          if (spatial_grid_internal::is_owner_cell(
+                cell, ranges_[id].lo, range->lo) and
+              overlaps(id, box))
+          {
+            std::invoke(callable, id, std::as_const(*values_[id]));
+          }
+        }
+      };
+
+      if (spatial_grid_internal::cell_count(*range) >
+          static_cast<double>(cells_.size()))
+      {
+        for (auto const& [cell, ids] : cells_)
+        {
+          if (spatial_grid_internal::in_range(cell, *range))
+          {
+            visit(cell, ids);
+          }
+        }
+        return;
+      }
+
+      spatial_grid_internal::for_each_cell(*range,
+                                           [&](auto const& cell)
+                                           {
+                                             auto it = cells_.find(cell);
+                                             if (it != cells_.end())
+                                             {
+                                               visit(cell, it->second);
+                                             }
+                                           });
+    }
+
+    // Broad phase: every overlapping pair is handed once to the narrow-phase
+    // handler, dispatched on the concrete shape types (see visit_pair).
+    template <typename Handler>
+    void for_each_pair(Handler&& handler) const
+    {
+      for (auto const& [cell, ids] : cells_)
+      {
+        for (size_type i = 0; i < ids.size(); ++i)
+        {
+          auto const lhs = ids[i];
+          for (size_type j = i + 1; j < ids.size(); ++j)
+          {
+            auto const rhs = ids[j];
+            if (spatial_grid_internal::is_owner_cell(
+                  cell, ranges_[lhs].lo, ranges_[rhs].lo) and
+                overlaps(lhs, rhs))
+            {
+              visit_pair(handler, *values_[lhs], *values_[rhs]);
+            }
+          }
+        }
+      }
+    }
+
+  private:
+    using range_type = spatial_grid_internal::cell_range<dimensions>;
+    using key_type   = spatial_grid_internal::cell_key<dimensions>;
+    using cell_map   = std::unordered_map<key_type,
+                                          std::vector<size_type>,
+                                          spatial_grid_internal::cell_hash<
+                                            dimensions>>;
+
+    void check(size_type id) const
+    {
+      if (not contains(id))
+      {
+        throw std::out_of_range("spatial_grid: invalid id");
+      }
+    }
+
+    // Clamped cell range of a box, nullopt when a bound is NaN.
+    std::optional<range_type> range_of(box_type const& box) const noexcept
+    {
+      constexpr auto limit = spatial_grid_internal::cell_limit;
+
+      auto const cell = [this](scalar_type bound)
+      {
+        return std::floor(static_cast<double>(bound) /
+                          static_cast<double>(cell_size_));
+      };
+
+      range_type range{};
+      for (std::size_t d = 0; d < dimensions; ++d)
+      {
+        auto const lo = cell(box.min[d]);
+        auto const hi = cell(box.max[d]);
+        if (std::isnan(lo) or std::isnan(hi))
+        {
+          return std::nullopt;
+        }
+        range.lo[d] = static_cast<std::int64_t>(std::clamp(lo, -limit, limit));
+        range.hi[d] = static_cast<std::int64_t>(std::clamp(hi, -limit, limit));
+      }
+      return range;
+    }
+
+    range_type checked_range_of(box_type const& box) const
+    {
+      for (std::size_t d = 0; d < dimensions; ++d)
+      {
+        if (not std::isfinite(static_cast<double>(box.min[d])) or
+            not std::isfinite(static_cast<double>(box.max[d])) or
+            box.max[d] < box.min[d])
+        {
+          throw std::invalid_argument(
+            "spatial_grid: bounding box must be finite and ordered");
+        }
+      }
+
+      auto const range = *range_of(box);
+      if (spatial_grid_internal::cell_count(range) >
+          static_cast<double>(max_cells_per_value))
+      {
+        throw std::length_error(
+          "spatial_grid: bounding box covers too many cells");
+      }
+      return range;
+    }
+
+    // drops the slots from id on, which were never handed out
+    void truncate(size_type id) noexcept
+    {
+      values_.resize(id);
+      ranges_.resize(std::min(ranges_.size(), id));
+      for (std::size_t d = 0; d < dimensions; ++d)
+      {
+        min_[d].resize(std::min(min_[d].size(), id));
+        max_[d].resize(std::min(max_[d].size(), id));
+      }
+    }
+
+    void store_box(size_type id, box_type const& box) noexcept
+    {
+      for (std::size_t d = 0; d < dimensions; ++d)
+      {
+        min_[d][id] = box.min[d];
+        max_[d][id] = box.max[d];
+      }
+    }
+
+    bool overlaps(size_type id, box_type const& box) const noexcept
+    {
+      bool result = true;
+      for (std::size_t d = 0; d < dimensions; ++d)
+      {
+        result &= (min_[d][id] <= box.max[d]) & (box.min[d] <= max_[d][id]);
+      }
+      return result;
+    }
+
+    bool overlaps(size_type lhs, size_type rhs) const noexcept
+    {
+      bool result = true;
+      for (std::size_t d = 0; d < dimensions; ++d)
+      {
+        result &=
+          (min_[d][lhs] <= max_[d][rhs]) & (min_[d][rhs] <= max_[d][lhs]);
+      }
+      return result;
+    }
+
+    // Links the id into every cell of the range, or into none when it
+    // throws.
+    void link(size_type id, range_type const& range)
+    {
+      std::size_t linked = 0;
+      key_type    failed{};
+      try
+      {
+        spatial_grid_internal::for_each_cell(range,
+                                             [&](auto const& cell)
+                                             {
+                                               failed = cell;
+                                               cells_[cell].push_back(id);
+                                               ++linked;
+                                             });
+      }
+      catch (...)
+      {
+        spatial_grid_internal::for_each_cell(range,
+                                             [&](auto const& cell)
+                                             {
+                                               if (linked != 0)
+                                               {
+                                                 --linked;
+                                                 unlink(id, cell);
+                                               }
+                                             });
+        if (auto it = cells_.find(failed);
+            it != cells_.end() and it->second.empty())
+        {
+          cells_.erase(it);
+        }
+        throw;
+      }
+    }
+
+    // Removes one link of the id from each cell of the range.
+    void unlink(size_type id, range_type const& range) noexcept
+    {
+      spatial_grid_internal::for_each_cell(
+        range,
+        [&](auto const& cell) { unlink(id, cell); });
+    }
+
+    void unlink(size_type id, key_type const& cell) noexcept
+    {
+      auto  it  = cells_.find(cell);
+      auto& ids = it->second;
+      *std::find(ids.begin(), ids.end(), id) = ids.back();
+      ids.pop_back();
+      if (ids.empty())
+      {
+        cells_.erase(it);
+      }
+    }
+
+    scalar_type                                       cell_size_;
+    std::vector<std::optional<T>>                     values_;
+    std::vector<range_type>                           ranges_;
+    std::array<std::vector<scalar_type>, dimensions> min_;
+    std::array<std::vector<scalar_type>, dimensions> max_;
+    std::vector<size_type>                            free_;
+    cell_map                                          cells_;
+    size_type                                         size_ = 0;
+  };
+} // namespace extra
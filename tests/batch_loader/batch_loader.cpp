@@ -0,0 +1,196 @@
+
+#include "local_store.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <extra/batch_loader.hpp>
+
+#include <chrono>
+#include <latch>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace client
+{
+  struct single_only
+  {
+    std::atomic<std::size_t> calls{ 0 };
+
+    // inject name
+    template <typename...>
+    struct trait;
+  };
+
+  template <>
+  struct single_only::trait<fetch_row>
+  {
+    int operator()(single_only& store, int key) const
+    {
+      store.calls.fetch_add(1);
+      return key * 2;
+    }
+  };
+
+  struct broken_store
+  {
+    // inject name
+    template <typename...>
+    struct trait;
+  };
+
+  template <>
+  struct broken_store::trait<fetch_row>
+  {
+    std::vector<int> operator()(broken_store&, std::span<int const>) const
+    {
+      throw std::runtime_error("unavailable");
+    }
+  };
+
+  // hashing throws for negative keys, copying throws once the budget is
+  // spent
+  struct touchy_key
+  {
+    int value;
+
+    static inline int copy_budget = -1;
+
+    explicit touchy_key(int v)
+      : value(v)
+    {}
+
+    touchy_key(touchy_key const& other)
+      : value(other.value)
+    {
+      if (copy_budget == 0)
+      {
+        throw std::runtime_error("touchy_key: copy refused");
+      }
+      if (copy_budget > 0)
+      {
+        --copy_budget;
+      }
+    }
+
+    friend bool operator==(touchy_key const&, touchy_key const&) = default;
+  };
+
+  struct touchy_hash
+  {
+    std::size_t operator()(touchy_key const& key) const
+    {
+      if (key.value < 0)
+      {
+        throw std::invalid_argument("touchy_hash: negative key");
+      }
+      return static_cast<std::size_t>(key.value);
+    }
+  };
+
+  struct touchy_store
+  {
+    // inject name
+    template <typename...>
+    struct trait;
+  };
+
+  template <>
+  struct touchy_store::trait<fetch_row>
+  {
+    int operator()(touchy_store&, touchy_key const& key) const
+    {
+      return key.value * 2;
+    }
+  };
+} // namespace client
+
+TEST_CASE("Batch loader coalesces concurrent loads", "[batch_loader]")
+{
+  using namespace client;
+  using namespace std::chrono_literals;
+
+  static_assert(extra::with_batch_trait<local_store, fetch_row, int>);
+  static_assert(not extra::with_batch_trait<single_only, fetch_row, int>);
+  static_assert(extra::with_loader_trait<single_only, fetch_row, int>);
+
+  SECTION("Deduplicate and batch keys from many threads")
+  {
+    local_store store;
+    extra::batch_loader<fetch_row, local_store, int> loader{
+      store, { .max_batch = 1000, .tick = 50ms }
+    };
+
+    constexpr int            threads = 16;
+    std::latch               start{ threads };
+    std::vector<std::string> rows(threads);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i)
+    {
+      workers.emplace_back(
+        [&, i]
+        {
+          start.arrive_and_wait();
+          rows[i] = loader.load(i % 4);
+        });
+    }
+    for (auto& worker : workers)
+    {
+      worker.join();
+    }
+
+    for (int i = 0; i < threads; ++i)
+    {
+      REQUIRE("row" + std::to_string(i % 4) == rows[i]);
+    }
+    REQUIRE(store.calls.load() == loader.dispatched());
+    REQUIRE(store.calls.load() < threads);
+    REQUIRE(store.keys.load() < threads);
+  }
+
+  SECTION("Dispatch as soon as the batch is full")
+  {
+    local_store store;
+    extra::batch_loader<fetch_row, local_store, int> loader{
+      store, { .max_batch = 1, .tick = 10s }
+    };
+
+    REQUIRE("row7" == loader.load(7));
+    REQUIRE("row8" == loader.load(8));
+    REQUIRE(2 == store.calls.load());
+  }
+
+  SECTION("Fall back to single-key calls")
+  {
+    single_only store;
+    extra::batch_loader<fetch_row, single_only, int> loader{ store };
+
+    REQUIRE(6 == loader.load(3));
+    REQUIRE(1 == store.calls.load());
+  }
+
+  SECTION("Propagate backend errors to every waiter")
+  {
+    broken_store store;
+    extra::batch_loader<fetch_row, broken_store, int> loader{ store };
+
+    REQUIRE_THROWS_AS(loader.load(1), std::runtime_error);
+  }
+
+  SECTION("Recover from a key that cannot be hashed or copied")
+  {
+    touchy_store store;
+    extra::batch_loader<fetch_row, touchy_store, touchy_key, touchy_hash>
+      loader{ store, { .tick = 1ms } };
+
+    REQUIRE_THROWS_AS(loader.load(touchy_key{ -1 }), std::invalid_argument);
+    REQUIRE(2 == loader.load(touchy_key{ 1 }));
+
+    // the index copy succeeds, the key list copy throws
+    touchy_key::copy_budget = 1;
+    REQUIRE_THROWS_AS(loader.load(touchy_key{ 2 }), std::runtime_error);
+    touchy_key::copy_budget = -1;
+    REQUIRE(4 == loader.load(touchy_key{ 2 }));
+    REQUIRE(2 == loader.dispatched());
+  }
+}
@@ -0,0 +1,73 @@
+
+#pragma once
+
+#include <extra/batch_loader.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace client
+{
+  struct fetch_row
+  {};
+
+  // Local stand-in for a storage engine behind a single connection: calls
+  // are serialized and each pays a fixed round trip, whatever the number of
+  // keys it carries.
+  struct local_store
+  {
+    std::chrono::microseconds round_trip{ 0 };
+    std::atomic<std::size_t>  calls{ 0 };
+    std::atomic<std::size_t>  keys{ 0 };
+    std::mutex                connection;
+
+    std::string read(int key)
+    {
+      keys.fetch_add(1, std::memory_order_relaxed);
+      return "row" + std::to_string(key);
+    }
+
+    void pay_round_trip()
+    {
+      std::lock_guard lock{ connection };
+      calls.fetch_add(1, std::memory_order_relaxed);
+      if (round_trip.count() != 0)
+      {
+        std::this_thread::sleep_for(round_trip);
+      }
+    }
+
+    // inject name
+    template <typename...>
+    struct trait;
+  };
+
+  template <>
+  struct local_store::trait<fetch_row>
+  {
+    std::string operator()(local_store& store, int key) const
+    {
+      store.pay_round_trip();
+      return store.read(key);
+    }
+
+    std::vector<std::string> operator()(local_store&          store,
+                                        std::span<int const> keys) const
+    {
+      store.pay_round_trip();
+      std::vector<std::string> rows;
+      rows.reserve(keys.size());
+      for (auto key : keys)
+      {
+        rows.push_back(store.read(key));
+      }
+      return rows;
+    }
+  };
+} // namespace client
@@ -0,0 +1,77 @@
+
+#include "local_store.hpp"
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <extra/batch_loader.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  template <typename Load>
+  std::size_t run_clients(int clients, int loads, Load load)
+  {
+    std::vector<std::thread> threads;
+    std::vector<std::size_t> sizes(static_cast<std::size_t>(clients));
+    for (int client = 0; client < clients; ++client)
+    {
+      threads.emplace_back(
+        [&, client]
+        {
+          for (int i = 0; i < loads; ++i)
+          {
+            sizes[static_cast<std::size_t>(client)] +=
+              load((client * 31 + i) % 512).size();
+          }
+        });
+    }
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+
+    std::size_t total = 0;
+    for (auto size : sizes)
+    {
+      total += size;
+    }
+    return total;
+  }
+} // namespace
+
+// hidden by default, run with: extra_tests "[batch_loader][benchmark]"
+TEST_CASE("Batch loader throughput", "[.][batch_loader][benchmark]")
+{
+  using namespace client;
+  using namespace std::chrono_literals;
+
+  constexpr int clients = 32;
+  constexpr int loads   = 50;
+
+  local_store store;
+  store.round_trip = 100us;
+
+  BENCHMARK("one key per call")
+  {
+    return run_clients(clients,
+                       loads,
+                       [&](int key)
+                       {
+                         return extra::trait_v<fetch_row>(store, key);
+                       });
+  };
+
+  BENCHMARK("coalesced")
+  {
+    extra::batch_loader<fetch_row, local_store, int> loader{
+      store, { .max_batch = clients, .tick = 100us }
+    };
+    return run_clients(clients,
+                       loads,
+                       [&](int key) { return loader.load(key); });
+  };
+}
@@ -0,0 +1,192 @@
+
+#include <catch2/catch_test_macros.hpp>
+#include <extra/constant_dispatch.hpp>
+#include <extra/overload.hpp>
+
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace domain
+{
+  struct to_string;
+} // namespace domain
+
+namespace client
+{
+  enum class rounding
+  {
+    nearest,
+    down,
+    up
+  };
+
+  enum class sparse
+  {
+    one   = 1,
+    ten   = 10,
+    fifty = 50
+  };
+
+  struct rounding_ext
+  {
+    template <typename...>
+    struct trait;
+  };
+
+  template <>
+  struct rounding_ext::trait<extra::enum_values>
+  {
+    static constexpr std::array values{ rounding::nearest,
+                                        rounding::down,
+                                        rounding::up };
+  };
+
+  template <>
+  struct rounding_ext::trait<domain::to_string>
+  {
+    constexpr char const* operator()(rounding r) const noexcept
+    {
+      switch (r)
+      {
+        case rounding::nearest:
+          return "nearest";
+        case rounding::down:
+          return "down";
+        case rounding::up:
+          return "up";
+        default:
+          return "";
+      }
+    }
+  };
+
+  struct sparse_ext
+  {
+    template <typename...>
+    struct trait;
+  };
+
+  template <>
+  struct sparse_ext::trait<extra::enum_values>
+  {
+    static constexpr std::array values{ sparse::one,
+                                        sparse::ten,
+                                        sparse::fifty };
+  };
+
+  // deduction guides for trait
+  auto trait(std::type_identity<rounding>) -> std::type_identity<rounding_ext>;
+  auto trait(std::type_identity<sparse>) -> std::type_identity<sparse_ext>;
+
+  template <rounding Mode, bool Clamp>
+  int kernel(std::vector<double> const& input)
+  {
+    int total = 0;
+    for (auto x : input)
+    {
+      int value = 0;
+      if constexpr (Mode == rounding::nearest)
+      {
+        value = static_cast<int>(x < 0 ? x - 0.5 : x + 0.5);
+      }
+      else if constexpr (Mode == rounding::down)
+      {
+        value = static_cast<int>(x) - (x < static_cast<int>(x) ? 1 : 0);
+      }
+      else
+      {
+        value = static_cast<int>(x) + (x > static_cast<int>(x) ? 1 : 0);
+      }
+
+      if constexpr (Clamp)
+      {
+        value = value < 0 ? 0 : value;
+      }
+      total += value;
+    }
+    return total;
+  }
+} // namespace client
+
+TEST_CASE("Lift runtime values to compile-time constants",
+          "[constant_dispatch]")
+{
+  using namespace client;
+  using namespace std::string_view_literals;
+
+  static_assert(extra::enumerable<bool>);
+  static_assert(extra::enumerable<rounding>);
+  static_assert(not extra::enumerable<int>);
+
+  SECTION("Lift a small integer")
+  {
+    auto square = [](auto n)
+    {
+      static_assert(std::is_same_v<int, typename decltype(n)::value_type>);
+      return n() * n();
+    };
+
+    REQUIRE(9 == extra::with_constant<0, 1, 2, 3>(3, square));
+    REQUIRE(64 == extra::with_constant<2, 4, 8>(8, square));
+    auto const bits = [&](int n)
+    {
+      return extra::with_constant<0, 1>(n, square);
+    };
+    REQUIRE_THROWS_AS(bits(2), std::out_of_range);
+  }
+
+  SECTION("Lift a bool")
+  {
+    auto describe = extra::overload{
+      [](std::true_type) { return "on"sv; },
+      [](std::false_type) { return "off"sv; },
+    };
+
+    REQUIRE("on"sv == extra::enum_dispatch(true, describe));
+    REQUIRE("off"sv == extra::enum_dispatch(false, describe));
+  }
+
+  SECTION("Lift an enum through its value table")
+  {
+    auto name = [](auto mode)
+    {
+      constexpr auto result = extra::trait_v<domain::to_string>(mode());
+      return std::string_view{ result };
+    };
+
+    REQUIRE("down"sv == extra::enum_dispatch(rounding::down, name));
+    REQUIRE("up"sv == extra::enum_dispatch(rounding::up, name));
+
+    auto value = [](auto e) { return static_cast<int>(e()); };
+    REQUIRE(10 == extra::enum_dispatch(sparse::ten, value));
+    REQUIRE(50 == extra::enum_dispatch(sparse::fifty, value));
+    REQUIRE_THROWS_AS(extra::enum_dispatch(static_cast<sparse>(2), value),
+                      std::out_of_range);
+  }
+
+  SECTION("Lift several flags through one flattened table")
+  {
+    std::vector<double> const input{ -1.5, 0.25, 2.75 };
+
+    auto run = [&input](auto mode, auto clamp)
+    {
+      return kernel<mode(), clamp()>(input);
+    };
+
+    REQUIRE(kernel<rounding::nearest, false>(input) ==
+            extra::enum_dispatch(std::tuple{ rounding::nearest, false }, run));
+    REQUIRE(kernel<rounding::down, true>(input) ==
+            extra::enum_dispatch(std::tuple{ rounding::down, true }, run));
+    REQUIRE(4 == extra::enum_dispatch(std::tuple{ rounding::up, true }, run));
+    REQUIRE(3 == extra::enum_dispatch(std::tuple{ rounding::up, false }, run));
+
+    auto mixed = extra::with_constants<extra::constant_list<1, 2, 3>,
+                                       extra::constant_list<false, true>>(
+      std::tuple{ 2, true },
+      [](auto n, auto negate) { return negate() ? -n() : n(); });
+    REQUIRE(-2 == mixed);
+  }
+}
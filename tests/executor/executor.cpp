@@ -0,0 +1,274 @@
+
+#include <catch2/catch_test_macros.hpp>
+#include <extra/executor.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <latch>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace client
+{
+  struct urgent_job
+  {
+    std::function<void()> body;
+
+    void operator()() const
+    {
+      body();
+    }
+
+    // inject name
+    template <typename...>
+    struct trait;
+  };
+
+  template <>
+  struct urgent_job::trait<extra::task_priority>
+  {
+    constexpr extra::priority operator()(urgent_job const&) const noexcept
+    {
+      return extra::priority::high;
+    }
+  };
+
+  struct pinned_job
+  {
+    std::size_t            worker;
+    std::function<void()> body;
+
+    void operator()() const
+    {
+      body();
+    }
+  };
+
+  struct bridged_job
+  {
+    std::function<void()> body;
+
+    void operator()() const
+    {
+      body();
+    }
+  };
+
+  struct bridged_job_ext
+  {
+    template <typename...>
+    struct trait;
+  };
+
+  template <>
+  struct bridged_job_ext::trait<extra::task_priority>
+  {
+    constexpr extra::priority operator()(bridged_job const&) const noexcept
+    {
+      return extra::priority::high;
+    }
+  };
+
+  auto trait(std::type_identity<bridged_job>)
+    -> std::type_identity<bridged_job_ext>;
+} // namespace client
+
+template <>
+struct extra::trait<extra::task_affinity, client::pinned_job>
+{
+  constexpr std::optional<std::size_t>
+  operator()(client::pinned_job const& job) const noexcept
+  {
+    return job.worker;
+  }
+};
+
+namespace
+{
+  void spawn_tree(extra::executor& pool,
+                  int              depth,
+                  std::atomic_int& leaves,
+                  std::latch&      done)
+  {
+    if (depth == 0)
+    {
+      leaves.fetch_add(1, std::memory_order_relaxed);
+      done.count_down();
+      return;
+    }
+
+    pool.submit([&pool, depth, &leaves, &done]
+                { spawn_tree(pool, depth - 1, leaves, done); });
+    spawn_tree(pool, depth - 1, leaves, done);
+  }
+} // namespace
+
+TEST_CASE("Work-stealing executor", "[executor]")
+{
+  using namespace client;
+
+  static_assert(extra::priority::normal ==
+                extra::trait_v<extra::task_priority>([] {}));
+  static_assert(not extra::trait_v<extra::task_affinity>([] {}));
+
+  REQUIRE(extra::priority::high ==
+          extra::trait_v<extra::task_priority>(bridged_job{}));
+  REQUIRE(not extra::trait_v<extra::task_affinity>(bridged_job{}));
+
+  SECTION("Run every submitted task")
+  {
+    extra::executor  pool{ 4 };
+    std::atomic_int  counter{ 0 };
+    std::latch       done{ 1000 };
+    for (int i = 0; i < 1000; ++i)
+    {
+      pool.submit(
+        [&]
+        {
+          counter.fetch_add(1, std::memory_order_relaxed);
+          done.count_down();
+        });
+    }
+    done.wait();
+    REQUIRE(1000 == counter.load());
+  }
+
+  SECTION("Run nested tasks spawned by workers")
+  {
+    extra::executor pool{ 3 };
+    std::atomic_int leaves{ 0 };
+    std::latch      done{ 1 << 10 };
+    pool.submit([&] { spawn_tree(pool, 10, leaves, done); });
+    done.wait();
+    REQUIRE((1 << 10) == leaves.load());
+  }
+
+  SECTION("Drain pending tasks on destruction")
+  {
+    std::atomic_int counter{ 0 };
+    {
+      extra::executor pool{ 2 };
+      for (int i = 0; i < 100; ++i)
+      {
+        pool.submit([&] { counter.fetch_add(1); });
+      }
+    }
+    REQUIRE(100 == counter.load());
+  }
+
+  SECTION("Higher priority lanes run first")
+  {
+    extra::executor    pool{ 1 };
+    std::promise<void> gate;
+    std::latch         blocked{ 1 };
+    pool.submit(
+      [&blocked, released = gate.get_future().share()]
+      {
+        blocked.count_down();
+        released.wait();
+      });
+    blocked.wait();
+
+    std::mutex       mutex;
+    std::vector<int> order;
+    auto record = [&](int value)
+    {
+      return [&, value]
+      {
+        std::lock_guard lock{ mutex };
+        order.push_back(value);
+      };
+    };
+
+    pool.submit(record(4), extra::priority::low);
+    pool.submit(record(3));
+    pool.submit(urgent_job{ record(1) });
+    auto bridged = pool.async(bridged_job{ record(2) });
+
+    auto last = pool.async([] { return 5; }, extra::priority::low);
+    gate.set_value();
+    REQUIRE(5 == last.get());
+    bridged.get();
+
+    std::lock_guard lock{ mutex };
+    REQUIRE(std::vector{ 1, 2, 3, 4 } == order);
+  }
+
+  SECTION("Affinity hints route to a worker")
+  {
+    // park both workers, then release one: its own inbox comes before the
+    // shared injection queue, and the other worker cannot steal meanwhile
+    extra::executor                   pool{ 2 };
+    std::array<std::promise<void>, 2> gates;
+    std::array<std::size_t, 2>        parked{};
+    std::latch                        blocked{ 2 };
+    for (std::size_t i = 0; i < gates.size(); ++i)
+    {
+      pool.submit(
+        [&, i, released = gates[i].get_future().share()]
+        {
+          parked[i] = *pool.current_worker();
+          blocked.count_down();
+          released.wait();
+        });
+    }
+    blocked.wait();
+
+    std::mutex                 mutex;
+    std::vector<int>           order;
+    std::optional<std::size_t> observed;
+    std::latch                 done{ 2 };
+    pool.submit(
+      [&]
+      {
+        std::lock_guard lock{ mutex };
+        order.push_back(2);
+        done.count_down();
+      });
+    pool.submit(pinned_job{ parked[0],
+                            [&]
+                            {
+                              std::lock_guard lock{ mutex };
+                              observed = pool.current_worker();
+                              order.push_back(1);
+                              done.count_down();
+                            } });
+
+    gates[0].set_value();
+    done.wait();
+    gates[1].set_value();
+
+    REQUIRE(observed == parked[0]);
+    REQUIRE(std::vector{ 1, 2 } == order);
+    REQUIRE(not pool.current_worker());
+  }
+
+  SECTION("Propagate exceptions through futures")
+  {
+    extra::executor pool{ 2 };
+    auto failed = pool.async([]() -> int { throw std::runtime_error("boom"); });
+    REQUIRE_THROWS_AS(failed.get(), std::runtime_error);
+  }
+
+  SECTION("Report exceptions escaping submitted tasks")
+  {
+    std::latch         reported{ 1 };
+    std::exception_ptr error;
+    extra::executor    pool{ 2,
+                          [&](std::exception_ptr e)
+                          {
+                            error = e;
+                            reported.count_down();
+                          } };
+    pool.submit([] { throw std::runtime_error("boom"); });
+    reported.wait();
+    REQUIRE_THROWS_AS(std::rethrow_exception(error), std::runtime_error);
+  }
+}
@@ -0,0 +1,62 @@
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <extra/executor.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <latch>
+#include <string>
+
+namespace
+{
+  void spawn_tree(extra::executor& pool, int depth, std::latch& done)
+  {
+    if (depth == 0)
+    {
+      done.count_down();
+      return;
+    }
+
+    pool.submit([&pool, depth, &done] { spawn_tree(pool, depth - 1, done); });
+    spawn_tree(pool, depth - 1, done);
+  }
+} // namespace
+
+// hidden by default, run with: extra_tests "[executor][benchmark]"
+TEST_CASE("Executor scalability", "[.][executor][benchmark]")
+{
+  constexpr int         depth    = 16;
+  constexpr std::size_t injected = 1 << 16;
+
+  for (std::size_t threads = 1; threads <= 64; threads *= 2)
+  {
+    extra::executor pool{ threads };
+    auto const      suffix = " (" + std::to_string(threads) + " threads)";
+
+    BENCHMARK("spawn tree" + suffix)
+    {
+      std::latch done{ 1 << depth };
+      pool.submit([&] { spawn_tree(pool, depth, done); });
+      done.wait();
+      return threads;
+    };
+
+    BENCHMARK("external submit" + suffix)
+    {
+      std::latch       done{ injected };
+      std::atomic_uint sink{ 0 };
+      for (std::size_t i = 0; i < injected; ++i)
+      {
+        pool.submit(
+          [&]
+          {
+            sink.fetch_add(1, std::memory_order_relaxed);
+            done.count_down();
+          });
+      }
+      done.wait();
+      return sink.load();
+    };
+  }
+}
@@ -0,0 +1,492 @@
+
+#include <catch2/catch_test_macros.hpp>
+#include <extra/executor.hpp>
+#include <extra/lsm_store.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <compare>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <latch>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace client
+{
+  // ordered newest first
+  struct timestamp
+  {
+    std::int64_t ticks;
+
+    // inject name
+    template <typename...>
+    struct trait;
+  };
+
+  template <>
+  struct timestamp::trait<extra::ordering>
+  {
+    std::weak_ordering operator()(timestamp lhs, timestamp rhs) const
+    {
+      return rhs.ticks <=> lhs.ticks;
+    }
+  };
+
+  template <>
+  struct timestamp::trait<extra::serialize>
+  {
+    void operator()(timestamp value, std::vector<std::byte>& out) const
+    {
+      extra::trait_v<extra::serialize>(value.ticks, out);
+    }
+  };
+
+  template <>
+  struct timestamp::trait<extra::deserialize>
+  {
+    timestamp operator()(std::span<std::byte const> bytes) const
+    {
+      return { extra::from_bytes<std::int64_t>(bytes) };
+    }
+  };
+
+  // ordered case-insensitively, stored as spelled
+  struct caseless
+  {
+    std::string text;
+
+    // inject name
+    template <typename...>
+    struct trait;
+  };
+
+  template <>
+  struct caseless::trait<extra::ordering>
+  {
+    std::weak_ordering operator()(caseless const& lhs,
+                                  caseless const& rhs) const
+    {
+      auto const lower = [](unsigned char c) { return std::tolower(c); };
+      return std::lexicographical_compare_three_way(
+        lhs.text.begin(),
+        lhs.text.end(),
+        rhs.text.begin(),
+        rhs.text.end(),
+        [&](unsigned char l, unsigned char r)
+        {
+          return lower(l) <=> lower(r);
+        });
+    }
+  };
+
+  template <>
+  struct caseless::trait<extra::serialize>
+  {
+    void operator()(caseless const& value, std::vector<std::byte>& out) const
+    {
+      extra::trait_v<extra::serialize>(value.text, out);
+    }
+  };
+
+  template <>
+  struct caseless::trait<extra::deserialize>
+  {
+    caseless operator()(std::span<std::byte const> bytes) const
+    {
+      return { extra::from_bytes<std::string>(bytes) };
+    }
+  };
+
+  // customised through the adl bridge, over the scalar defaults
+  enum class level : std::uint8_t
+  {
+    low,
+    high
+  };
+
+  struct level_ext
+  {
+    template <typename...>
+    struct trait;
+  };
+
+  // high before low
+  template <>
+  struct level_ext::trait<extra::ordering>
+  {
+    std::weak_ordering operator()(level lhs, level rhs) const
+    {
+      return rhs <=> lhs;
+    }
+  };
+
+  // one character per level
+  template <>
+  struct level_ext::trait<extra::serialize>
+  {
+    void operator()(level value, std::vector<std::byte>& out) const
+    {
+      out.push_back(value == level::high ? std::byte{ 'h' } : std::byte{ 'l' });
+    }
+  };
+
+  template <>
+  struct level_ext::trait<extra::deserialize>
+  {
+    level operator()(std::span<std::byte const> bytes) const
+    {
+      return bytes.size() == 1 and bytes[0] == std::byte{ 'h' } ? level::high
+                                                                 : level::low;
+    }
+  };
+
+  auto trait(std::type_identity<level>) -> std::type_identity<level_ext>;
+} // namespace client
+
+namespace
+{
+  struct scratch_directory
+  {
+    explicit scratch_directory(std::string const& name)
+      : path(std::filesystem::temp_directory_path() / ("extra_lsm_" + name))
+    {
+      std::filesystem::remove_all(path);
+    }
+
+    ~scratch_directory()
+    {
+      std::error_code ignored;
+      std::filesystem::remove_all(path, ignored);
+    }
+
+    std::filesystem::path path;
+  };
+
+  template <typename Store, typename As>
+  concept gettable_as = requires(Store const&                     store,
+                                 typename Store::key_type const& key) {
+    store.template get<As>(key);
+  };
+
+  template <typename Store, typename Key>
+  std::vector<std::pair<Key, std::string>> scan_all(Store const& store,
+                                                    Key const&   first,
+                                                    Key const&   last)
+  {
+    std::vector<std::pair<Key, std::string>> rows;
+    store.template scan<std::string_view>(
+      first,
+      last,
+      [&](Key const& key, std::string_view value)
+      {
+        rows.emplace_back(key, std::string{ value });
+      });
+    return rows;
+  }
+} // namespace
+
+TEST_CASE("Log-structured store", "[lsm_store]")
+{
+  using store_type = extra::lsm_store<std::string, std::string>;
+
+  static_assert(extra::serializable<std::string>);
+  static_assert(extra::ordered<std::string>);
+  static_assert(not extra::ordered<double>);
+
+  // views would dangle once get returns
+  static_assert(gettable_as<store_type, std::string>);
+  static_assert(not gettable_as<store_type, std::string_view>);
+
+  SECTION("Read back from the memtable and sorted runs")
+  {
+    scratch_directory dir{ "read" };
+    store_type        store{ dir.path, { .compaction_trigger = 100 } };
+
+    store.put("apple", "red");
+    store.put("banana", "yellow");
+    REQUIRE("red" == store.get("apple"));
+
+    store.flush();
+    REQUIRE(1 == store.run_count());
+    store.put("apple", "green");
+    store.erase("banana");
+
+    REQUIRE("green" == store.get("apple"));
+    REQUIRE(not store.get("banana"));
+    REQUIRE(not store.get("cherry"));
+
+    store.flush();
+    REQUIRE(2 == store.run_count());
+    REQUIRE("green" == store.get("apple"));
+    REQUIRE(not store.get("banana"));
+
+    // zero-copy view into the mapped run, valid during the callback
+    std::string viewed;
+    REQUIRE(store.read<std::string_view>(
+      "apple",
+      [&](std::string_view value) { viewed = value; }));
+    REQUIRE("green" == viewed);
+  }
+
+  SECTION("Scan merges sources in key order")
+  {
+    scratch_directory dir{ "scan" };
+    store_type        store{ dir.path, { .compaction_trigger = 100 } };
+
+    store.put("a", "1");
+    store.put("c", "3");
+    store.put("e", "5");
+    store.flush();
+    store.put("b", "2");
+    store.put("c", "three");
+    store.flush();
+    store.erase("e");
+    store.put("d", "4");
+
+    using row = std::pair<std::string, std::string>;
+    REQUIRE(std::vector<row>{
+              { "b", "2" }, { "c", "three" }, { "d", "4" } } ==
+            scan_all(store, std::string{ "b" }, std::string{ "z" }));
+    REQUIRE(std::vector<row>{ { "a", "1" } } ==
+            scan_all(store, std::string{ "" }, std::string{ "b" }));
+  }
+
+  SECTION("Search runs on bytes beyond ascii")
+  {
+    scratch_directory dir{ "bytes" };
+    store_type        store{ dir.path, { .compaction_trigger = 100 } };
+
+    // std::string orders as unsigned char, so "\xff" sorts after "z"
+    store.put("\xff", "high");
+    store.put("z", "last ascii");
+    store.put("\x80z", "middle");
+    store.put("", "empty");
+    store.flush();
+
+    REQUIRE("high" == store.get("\xff"));
+    REQUIRE("middle" == store.get("\x80z"));
+    REQUIRE("empty" == store.get(""));
+    REQUIRE(not store.get("\x80"));
+
+    using row = std::pair<std::string, std::string>;
+    REQUIRE(
+      std::vector<row>{ { "\x80z", "middle" }, { "\xff", "high" } } ==
+      scan_all(store, std::string{ "\x80" }, std::string{ "\xff\xff" }));
+  }
+
+  SECTION("Compaction keeps the newest values and survives reopening")
+  {
+    scratch_directory dir{ "compact" };
+    {
+      store_type store{ dir.path,
+                        { .memtable_bytes = 1024, .compaction_trigger = 100 } };
+      for (int i = 0; i < 500; ++i)
+      {
+        store.put("key" + std::to_string(i), "v" + std::to_string(i));
+      }
+      for (int i = 0; i < 500; i += 2)
+      {
+        store.erase("key" + std::to_string(i));
+      }
+      REQUIRE(1 < store.run_count());
+
+      store.compact();
+      REQUIRE(1 == store.run_count());
+      REQUIRE(not store.get("key10"));
+      REQUIRE("v11" == store.get("key11"));
+      store.put("key10", "back");
+    }
+
+    store_type reopened{ dir.path };
+    REQUIRE(1 <= reopened.run_count());
+    REQUIRE("back" == reopened.get("key10"));
+    REQUIRE("v499" == reopened.get("key499"));
+    REQUIRE(not reopened.get("key498"));
+  }
+
+  SECTION("Reject runs whose layout does not fit the file")
+  {
+    scratch_directory dir{ "corrupted" };
+    std::filesystem::create_directories(dir.path);
+    {
+      // valid magic, but the offsets and bloom bits lie past the end
+      std::uint64_t const footer[] = { 0x316e75722d6d736cull, 5, 0, 1000, 7 };
+      std::ofstream       file{ dir.path / "00000000000000000001-000000.run",
+                          std::ios::binary };
+      file.write(reinterpret_cast<char const*>(footer), sizeof(footer));
+    }
+
+    REQUIRE_THROWS_AS([&] { store_type{ dir.path }; }(), std::runtime_error);
+  }
+
+  SECTION("Background compaction on the executor")
+  {
+    scratch_directory dir{ "background" };
+    extra::executor   pool{ 2 };
+
+    // park both workers: compactions can only queue up meanwhile
+    std::promise<void> gate;
+    std::latch         parked{ 2 };
+    auto const         released = gate.get_future().share();
+    for (int i = 0; i < 2; ++i)
+    {
+      pool.submit(
+        [&parked, released]
+        {
+          parked.count_down();
+          released.wait();
+        });
+    }
+    parked.wait();
+
+    {
+      store_type store{ dir.path,
+                        { .memtable_bytes     = 256,
+                          .compaction_trigger = 3 },
+                        &pool };
+      for (int i = 0; i < 2000; ++i)
+      {
+        store.put(std::to_string(i % 300), std::to_string(i));
+      }
+      REQUIRE(3 < store.run_count());
+
+      gate.set_value();
+      auto const deadline = std::chrono::steady_clock::now() +
+                            std::chrono::seconds{ 30 };
+      while (store.run_count() >= 3 and
+             std::chrono::steady_clock::now() < deadline)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+      }
+      REQUIRE(store.run_count() < 3);
+      REQUIRE("1999" == store.get("199"));
+    }
+  }
+
+  SECTION("Report failed compactions")
+  {
+    scratch_directory dir{ "failed" };
+
+    // a directory in the way of the temporary file of the compacted run
+    auto const blocker = dir.path / "00000000000000000002-000001.run.tmp";
+    auto const block   = [&]
+    {
+      std::filesystem::create_directories(blocker);
+      std::ofstream{ blocker / "keep" } << "busy";
+    };
+
+    {
+      store_type store{ dir.path, { .compaction_trigger = 100 } };
+      store.put("a", "1");
+      store.flush();
+      store.put("b", "2");
+      store.flush();
+      block();
+
+      REQUIRE_THROWS(store.compact());
+      REQUIRE(2 == store.run_count());
+      REQUIRE("1" == store.get("a"));
+
+      std::filesystem::remove_all(blocker);
+      store.compact();
+      REQUIRE(1 == store.run_count());
+    }
+
+    std::filesystem::remove_all(dir.path);
+    extra::executor pool{ 1 };
+
+    // park the worker: the failure is reported by the next call
+    std::promise<void> gate;
+    std::latch         parked{ 1 };
+    pool.submit(
+      [&parked, released = gate.get_future().share()]
+      {
+        parked.count_down();
+        released.wait();
+      });
+    parked.wait();
+
+    {
+      store_type store{ dir.path, { .compaction_trigger = 2 }, &pool };
+      store.put("a", "1");
+      store.flush();
+      block();
+      store.put("b", "2");
+      store.flush();
+
+      gate.set_value();
+      REQUIRE_THROWS(store.compact());
+      REQUIRE(2 == store.run_count());
+
+      std::filesystem::remove_all(blocker);
+      store.compact();
+      REQUIRE(1 == store.run_count());
+      REQUIRE("2" == store.get("b"));
+    }
+  }
+
+  SECTION("Keys ordered through the ordering trait")
+  {
+    using namespace client;
+
+    scratch_directory                     dir{ "ordering" };
+    extra::lsm_store<timestamp, std::int64_t> store{ dir.path };
+
+    store.put({ 1 }, 10);
+    store.put({ 3 }, 30);
+    store.flush();
+    store.put({ 2 }, 20);
+
+    std::vector<std::int64_t> values;
+    store.scan(timestamp{ 100 },
+               timestamp{ 0 },
+               [&](timestamp, std::int64_t value) { values.push_back(value); });
+    REQUIRE(std::vector<std::int64_t>{ 30, 20, 10 } == values);
+  }
+
+  SECTION("Keys equal under the ordering but encoded differently")
+  {
+    using namespace client;
+
+    scratch_directory                      dir{ "caseless" };
+    extra::lsm_store<caseless, std::string> store{ dir.path };
+
+    store.put({ "ABC" }, "upper");
+    REQUIRE("upper" == store.get({ "abc" }));
+
+    // the Bloom filter hashes encodings, it must not hide the run
+    store.flush();
+    REQUIRE("upper" == store.get({ "abc" }));
+    REQUIRE(not store.get({ "abd" }));
+  }
+
+  SECTION("Keys customised through the adl bridge")
+  {
+    using namespace client;
+
+    REQUIRE(1 == extra::to_bytes(level::high).size());
+
+    scratch_directory                  dir{ "adl_bridge" };
+    extra::lsm_store<level, std::string> store{ dir.path };
+
+    store.put(level::low, "low");
+    store.flush();
+    store.put(level::high, "high");
+
+    std::vector<std::string> values;
+    store.scan(level::high,
+               level::low,
+               [&](level, std::string value) { values.push_back(value); });
+    REQUIRE(std::vector<std::string>{ "high" } == values);
+    REQUIRE("low" == store.get(level::low));
+  }
+}
@@ -0,0 +1,163 @@
+
+#include <catch2/catch_test_macros.hpp>
+#include <extra/overload.hpp>
+#include <extra/record_batch.hpp>
+
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  using row = std::tuple<int, double, std::string>;
+
+  std::vector<row> make_rows(int count)
+  {
+    std::vector<row> rows;
+    for (int i = 0; i < count; ++i)
+    {
+      rows.emplace_back(i, i * 0.5, "r" + std::to_string(i));
+    }
+    return rows;
+  }
+
+  // neither default constructible nor always copyable
+  struct label
+  {
+    explicit label(int value)
+      : id(value)
+    {}
+
+    label(label const& other)
+      : id(other.id)
+    {
+      if (id < 0)
+      {
+        throw std::runtime_error("label: copy refused");
+      }
+    }
+
+    int id;
+  };
+
+  template <typename Batch>
+  concept with_to_rows = requires(Batch const& batch) { batch.to_rows(); };
+} // namespace
+
+TEST_CASE("Record batches", "[record_batch]")
+{
+  // spans several transpose tiles
+  auto const rows = make_rows(3000);
+
+  extra::record_batch<int, double, std::string> batch{
+    std::span<row const>{ rows }
+  };
+
+  SECTION("Transpose rows into columns and back")
+  {
+    REQUIRE(rows.size() == batch.size());
+    REQUIRE(1234 == batch.column<0>()[1234]);
+    REQUIRE(617.0 == batch.column<1>()[1234]);
+    REQUIRE("r1234" == batch.column<2>()[1234]);
+    REQUIRE(rows == batch.to_rows());
+  }
+
+  SECTION("Append and push back")
+  {
+    batch.push_back({ -1, -0.5, "tail" });
+    batch.append(std::span<row const>{ rows }.first(10));
+    REQUIRE(rows.size() + 11 == batch.size());
+    REQUIRE("tail" == batch.column<2>()[rows.size()]);
+    REQUIRE(9 == batch.column<0>().back());
+  }
+
+  SECTION("Slice without copying")
+  {
+    auto const slice = batch.slice(100, 50);
+    REQUIRE(50 == slice.size());
+    REQUIRE(batch.column<1>().data() + 100 == slice.column<1>().data());
+
+    auto const nested = slice.slice(10, 5);
+    REQUIRE(110 == std::get<0>(nested.row(0)));
+
+    std::vector<row> expected(rows.begin() + 110, rows.begin() + 115);
+    REQUIRE(expected == nested.to_rows());
+
+    REQUIRE_THROWS_AS(slice.slice(40, 11), std::out_of_range);
+  }
+
+  SECTION("Rows of mutable views are references")
+  {
+    auto view                = batch.slice(0, 2);
+    std::get<2>(view.row(1)) = "changed";
+    REQUIRE("changed" == batch.column<2>()[1]);
+
+    static_assert(std::is_same_v<std::tuple<int const&, double const&,
+                                            std::string const&>,
+                                 decltype(std::as_const(batch).view().row(0))>);
+  }
+
+  SECTION("Visit rows with tuple_visit")
+  {
+    double      numbers = 0;
+    std::size_t text    = 0;
+    REQUIRE(extra::tuple_visit_rows(
+      extra::overload{
+        [&](int value) { numbers += value; },
+        [&](double value) { numbers += value; },
+        [&](std::string const& value) { text += value.size(); },
+      },
+      std::as_const(batch).slice(0, 4)));
+    REQUIRE(6 + 3.0 == numbers);
+    REQUIRE(8 == text);
+
+    // a predicate stops the walk on the first matching field
+    std::size_t visited = 0;
+    REQUIRE(not extra::tuple_visit_rows(
+      [&](auto const& value)
+      {
+        ++visited;
+        if constexpr (std::is_same_v<std::remove_cvref_t<decltype(value)>,
+                                     std::string>)
+        {
+          return value == "r2";
+        }
+        else
+        {
+          return false;
+        }
+      },
+      batch.view()));
+    REQUIRE(9 == visited);
+  }
+
+  SECTION("Copy construct non-trivial columns")
+  {
+    using labelled = std::tuple<int, label>;
+    static_assert(not with_to_rows<extra::record_batch<int, label>>);
+
+    std::vector<labelled> labels;
+    for (int i = 0; i < 100; ++i)
+    {
+      labels.emplace_back(i, label{ i });
+    }
+
+    extra::record_batch<int, label> labelled_batch{
+      std::span<labelled const>{ labels }
+    };
+    REQUIRE(100 == labelled_batch.size());
+    REQUIRE(42 == labelled_batch.column<1>()[42].id);
+
+    // the last copy throws, after the int column already grew
+    labels.emplace_back(-1, label{ 0 });
+    std::get<1>(labels.back()).id = -1;
+    REQUIRE_THROWS_AS(
+      labelled_batch.append(std::span<labelled const>{ labels }),
+      std::runtime_error);
+    REQUIRE(100 == labelled_batch.column<0>().size());
+    REQUIRE(100 == labelled_batch.column<1>().size());
+  }
+}
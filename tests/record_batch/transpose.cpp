@@ -0,0 +1,57 @@
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <extra/record_batch.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+// hidden by default, run with: extra_tests "[record_batch][benchmark]"
+TEST_CASE("Record batch transpose", "[.][record_batch][benchmark]")
+{
+  using row = std::tuple<std::int32_t, double, float, std::int64_t>;
+
+  std::vector<row> rows;
+  for (std::int32_t i = 0; i < (1 << 20); ++i)
+  {
+    rows.emplace_back(i, i * 0.5, i * 0.25f, std::int64_t{ i } << 20);
+  }
+
+  // presized like the batch columns, so only the access pattern differs
+  BENCHMARK("row by row std::get")
+  {
+    std::vector<std::int32_t> a(rows.size());
+    std::vector<double>       b(rows.size());
+    std::vector<float>        c(rows.size());
+    std::vector<std::int64_t> d(rows.size());
+    for (std::size_t i = 0; i < rows.size(); ++i)
+    {
+      a[i] = std::get<0>(rows[i]);
+      b[i] = std::get<1>(rows[i]);
+      c[i] = std::get<2>(rows[i]);
+      d[i] = std::get<3>(rows[i]);
+    }
+    return a.size() + b.size() + c.size() + d.size();
+  };
+
+  BENCHMARK("tiled AoS to SoA")
+  {
+    extra::record_batch<std::int32_t, double, float, std::int64_t> batch{
+      std::span<row const>{ rows }
+    };
+    return batch.size();
+  };
+
+  extra::record_batch<std::int32_t, double, float, std::int64_t> batch{
+    std::span<row const>{ rows }
+  };
+  std::vector<row> out(rows.size());
+
+  BENCHMARK("tiled SoA to AoS")
+  {
+    batch.view().copy_rows(out);
+    return out.size();
+  };
+}
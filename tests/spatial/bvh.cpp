@@ -0,0 +1,129 @@
+
+#include "shapes.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <extra/bvh.hpp>
+#include <extra/overload.hpp>
+
+#include <cstdint>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  std::vector<client::circle> make_circles(std::size_t count)
+  {
+    std::uint32_t seed   = 777;
+    auto          random = [&seed](float scale)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      return static_cast<float>(seed >> 8) / static_cast<float>(1u << 24) *
+             scale;
+    };
+
+    std::vector<client::circle> circles;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      circles.push_back({ random(200.f), random(200.f), 0.5f + random(2.f) });
+    }
+    return circles;
+  }
+
+  template <typename Shapes>
+  std::set<std::pair<std::size_t, std::size_t>>
+  brute_force_pairs(Shapes const& shapes)
+  {
+    std::set<std::pair<std::size_t, std::size_t>> pairs;
+    for (std::size_t i = 0; i < shapes.size(); ++i)
+    {
+      for (std::size_t j = i + 1; j < shapes.size(); ++j)
+      {
+        auto const lhs = extra::trait_v<extra::bounding_box>(shapes[i]);
+        auto const rhs = extra::trait_v<extra::bounding_box>(shapes[j]);
+        if (lhs.overlaps(rhs))
+        {
+          pairs.emplace(i, j);
+        }
+      }
+    }
+    return pairs;
+  }
+} // namespace
+
+TEST_CASE("Bounding volume hierarchy", "[bvh]")
+{
+  using namespace client;
+
+  SECTION("Empty tree")
+  {
+    extra::bvh<circle> tree{ {} };
+    std::size_t        calls = 0;
+    tree.query({ { 0.f, 0.f }, { 1.f, 1.f } },
+               [&](std::size_t, circle const&) { ++calls; });
+    tree.for_each_pair([&](circle const&, circle const&) { ++calls; });
+    REQUIRE(0 == calls);
+  }
+
+  SECTION("Pairs match the brute force")
+  {
+    // large enough to take the parallel build path
+    auto const        circles = make_circles(10000);
+    extra::bvh<circle> tree{ circles };
+
+    std::size_t pairs = 0;
+    tree.for_each_pair([&](circle const&, circle const&) { ++pairs; });
+    REQUIRE(brute_force_pairs(circles).size() == pairs);
+  }
+
+  SECTION("Query and incremental refit")
+  {
+    auto const         circles = make_circles(300);
+    extra::bvh<circle> tree{ circles, 2 };
+
+    box2 const area{ { 50.f, 50.f }, { 80.f, 120.f } };
+
+    std::set<std::size_t> found;
+    tree.query(area, [&](std::size_t id, circle const&) { found.insert(id); });
+
+    std::set<std::size_t> expected;
+    for (std::size_t id = 0; id < circles.size(); ++id)
+    {
+      if (extra::trait_v<extra::bounding_box>(circles[id]).overlaps(area))
+      {
+        expected.insert(id);
+      }
+    }
+    REQUIRE(expected == found);
+
+    auto const moved = expected.empty() ? std::size_t{ 0 } : *expected.begin();
+    tree.update(moved, circle{ 500.f, 500.f, 1.f });
+    REQUIRE(500.f + 1.f == tree.bounds().max[0]);
+
+    found.clear();
+    tree.query(area, [&](std::size_t id, circle const&) { found.insert(id); });
+    REQUIRE(not found.contains(moved));
+  }
+
+  SECTION("Narrow phase on erased shapes")
+  {
+    std::vector<shape> shapes{
+      circle{ 0.f, 0.f, 1.f },
+      rect{ 0.5f, 0.5f, 1.f, 1.f },
+      rect{ 1.f, 1.f, 1.f, 1.f },
+      circle{ 10.f, 10.f, 1.f },
+    };
+    extra::bvh<shape> tree{ shapes, 1 };
+
+    std::size_t mixed = 0;
+    std::size_t rects = 0;
+    tree.for_each_pair(extra::overload{
+      [&](circle const&, circle const&) {},
+      [&](rect const&, rect const&) { ++rects; },
+      [&](circle const&, rect const&) { ++mixed; },
+      [&](rect const&, circle const&) { ++mixed; },
+    });
+    REQUIRE(2 == mixed);
+    REQUIRE(1 == rects);
+  }
+}
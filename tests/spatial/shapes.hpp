@@ -0,0 +1,54 @@
+
+#pragma once
+
+#include <extra/bounding_box.hpp>
+
+#include <variant>
+
+namespace client
+{
+  using box2 = extra::aabb<float, 2>;
+
+  struct circle
+  {
+    float x;
+    float y;
+    float r;
+
+    // inject name
+    template <typename...>
+    struct trait;
+  };
+
+  template <>
+  struct circle::trait<extra::bounding_box>
+  {
+    constexpr box2 operator()(circle const& c) const noexcept
+    {
+      return { { c.x - c.r, c.y - c.r }, { c.x + c.r, c.y + c.r } };
+    }
+  };
+
+  struct rect
+  {
+    float x;
+    float y;
+    float w;
+    float h;
+
+    // inject name
+    template <typename...>
+    struct trait;
+  };
+
+  template <>
+  struct rect::trait<extra::bounding_box>
+  {
+    constexpr box2 operator()(rect const& r) const noexcept
+    {
+      return { { r.x, r.y }, { r.x + r.w, r.y + r.h } };
+    }
+  };
+
+  using shape = std::variant<circle, rect>;
+} // namespace client
@@ -0,0 +1,248 @@
+
+#include "shapes.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <extra/overload.hpp>
+#include <extra/spatial_grid.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  std::vector<client::shape> make_shapes(std::size_t count)
+  {
+    std::uint32_t seed   = 12345;
+    auto          random = [&seed](float scale)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      return static_cast<float>(seed >> 8) / static_cast<float>(1u << 24) *
+             scale;
+    };
+
+    std::vector<client::shape> shapes;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      if (i % 2 == 0)
+      {
+        shapes.emplace_back(
+          client::circle{ random(100.f), random(100.f), random(3.f) });
+      }
+      else
+      {
+        shapes.emplace_back(client::rect{
+          random(100.f) - 50.f, random(100.f), random(6.f), random(6.f) });
+      }
+    }
+    return shapes;
+  }
+
+  // refuses to be moved into the grid when flagged
+  struct fragile
+  {
+    client::box2 box;
+    bool         refuse = false;
+
+    fragile(client::box2 bounds, bool refuse_move)
+      : box(bounds)
+      , refuse(refuse_move)
+    {}
+
+    fragile(fragile const&) = default;
+
+    fragile(fragile&& other)
+      : box(other.box)
+      , refuse(other.refuse)
+    {
+      if (refuse)
+      {
+        throw std::runtime_error("fragile: move refused");
+      }
+    }
+
+    fragile& operator=(fragile const&) = default;
+
+    // inject name
+    template <typename...>
+    struct trait;
+  };
+
+  template <>
+  struct fragile::trait<extra::bounding_box>
+  {
+    constexpr client::box2 operator()(fragile const& f) const noexcept
+    {
+      return f.box;
+    }
+  };
+
+  std::size_t brute_force_pairs(std::vector<client::shape> const& shapes)
+  {
+    std::size_t pairs = 0;
+    for (std::size_t i = 0; i < shapes.size(); ++i)
+    {
+      for (std::size_t j = i + 1; j < shapes.size(); ++j)
+      {
+        auto const lhs = extra::trait_v<extra::bounding_box>(shapes[i]);
+        auto const rhs = extra::trait_v<extra::bounding_box>(shapes[j]);
+        pairs += lhs.overlaps(rhs) ? 1 : 0;
+      }
+    }
+    return pairs;
+  }
+} // namespace
+
+TEST_CASE("Spatial grid broad phase", "[spatial_grid]")
+{
+  using namespace client;
+
+  static_assert(extra::bounded<circle>);
+  static_assert(extra::bounded<shape>);
+  static_assert(not extra::bounded<int>);
+
+  auto const shapes = make_shapes(500);
+
+  extra::spatial_grid<shape> grid{ 4.f };
+  for (auto const& s : shapes)
+  {
+    grid.insert(s);
+  }
+  REQUIRE(shapes.size() == grid.size());
+
+  SECTION("Report every overlapping pair once")
+  {
+    std::size_t circles = 0;
+    std::size_t mixed   = 0;
+    std::size_t rects   = 0;
+
+    grid.for_each_pair(extra::overload{
+      [&](circle const&, circle const&) { ++circles; },
+      [&](rect const&, rect const&) { ++rects; },
+      [&](circle const&, rect const&) { ++mixed; },
+      [&](rect const&, circle const&) { ++mixed; },
+    });
+
+    REQUIRE(brute_force_pairs(shapes) == circles + mixed + rects);
+    REQUIRE(0 < circles);
+    REQUIRE(0 < rects);
+  }
+
+  SECTION("Query reports each overlapping value once")
+  {
+    box2 const area{ { 10.f, 10.f }, { 30.f, 45.f } };
+
+    std::set<std::size_t> found;
+    std::size_t           calls = 0;
+    grid.query(area,
+               [&](std::size_t id, shape const& s)
+               {
+                 ++calls;
+                 found.insert(id);
+                 REQUIRE(extra::trait_v<extra::bounding_box>(s).overlaps(area));
+               });
+    REQUIRE(found.size() == calls);
+
+    std::size_t expected = 0;
+    for (auto const& s : shapes)
+    {
+      expected += extra::trait_v<extra::bounding_box>(s).overlaps(area);
+    }
+    REQUIRE(expected == calls);
+  }
+
+  SECTION("Update and erase incrementally")
+  {
+    extra::spatial_grid<shape> small{ 1.f };
+    auto a = small.insert(circle{ 0.f, 0.f, 1.f });
+    auto b = small.insert(rect{ 10.f, 10.f, 2.f, 2.f });
+
+    std::size_t pairs = 0;
+    auto count = [&pairs](auto const&, auto const&) { ++pairs; };
+
+    small.for_each_pair(count);
+    REQUIRE(0 == pairs);
+
+    small.update(b, rect{ 0.5f, 0.5f, 2.f, 2.f });
+    small.for_each_pair(count);
+    REQUIRE(1 == pairs);
+
+    small.erase(a);
+    REQUIRE(1 == small.size());
+    REQUIRE(not small.contains(a));
+
+    auto c = small.insert(circle{ 1.f, 1.f, 0.5f });
+    REQUIRE(c == a);
+
+    pairs = 0;
+    small.for_each_pair(count);
+    REQUIRE(1 == pairs);
+  }
+
+  SECTION("Queries larger than the occupied cells scan the occupied cells")
+  {
+    auto const inf = std::numeric_limits<float>::infinity();
+
+    std::size_t calls = 0;
+    grid.query(box2{ { -1e6f, -1e6f }, { 1e6f, 1e6f } },
+               [&calls](std::size_t, shape const&) { ++calls; });
+    REQUIRE(shapes.size() == calls);
+
+    calls = 0;
+    grid.query(box2{ { -inf, -inf }, { inf, inf } },
+               [&calls](std::size_t, shape const&) { ++calls; });
+    REQUIRE(shapes.size() == calls);
+
+    calls = 0;
+    grid.query(box2{ { std::numeric_limits<float>::quiet_NaN(), 0.f },
+                     { 1.f, 1.f } },
+               [&calls](std::size_t, shape const&) { ++calls; });
+    REQUIRE(0 == calls);
+  }
+
+  SECTION("Reject boxes that cannot be linked")
+  {
+    auto const inf = std::numeric_limits<float>::infinity();
+
+    REQUIRE_THROWS_AS(grid.insert(rect{ 0.f, 0.f, inf, 1.f }),
+                      std::invalid_argument);
+    REQUIRE_THROWS_AS(grid.insert(rect{ 0.f, 0.f, -1.f, 1.f }),
+                      std::invalid_argument);
+    REQUIRE_THROWS_AS(grid.insert(rect{ 0.f, 0.f, 1e7f, 1e7f }),
+                      std::length_error);
+    REQUIRE(shapes.size() == grid.size());
+
+    REQUIRE_THROWS_AS(grid.update(0, circle{ 0.f, 0.f, inf }),
+                      std::invalid_argument);
+    REQUIRE(std::holds_alternative<circle>(grid[0]));
+  }
+
+  SECTION("A failed insert leaves no links behind")
+  {
+    extra::spatial_grid<fragile> small{ 1.f };
+    box2 const                   area{ { 0.f, 0.f }, { 3.f, 3.f } };
+
+    auto const freed = small.insert(fragile{ area, false });
+    small.erase(freed);
+
+    fragile const refused{ area, true };
+    REQUIRE_THROWS_AS(small.insert(refused), std::runtime_error);
+    REQUIRE(0 == small.size());
+    REQUIRE(not small.contains(freed));
+
+    std::size_t found = 0;
+    small.query(area, [&found](std::size_t, fragile const&) { ++found; });
+    REQUIRE(0 == found);
+
+    auto const a = small.insert(fragile{ area, false });
+    small.insert(fragile{ area, false });
+    REQUIRE(freed == a);
+
+    std::size_t pairs = 0;
+    small.for_each_pair([&pairs](fragile const&, fragile const&) { ++pairs; });
+    REQUIRE(1 == pairs);
+  }
+}